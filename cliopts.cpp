@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "cliopts.h"
+
+using namespace std;
+
+#ifndef _MSC_VER
+
+static const struct {
+	const char* name;
+	uint32_t flag;
+} stripModes[] = {
+	{"link",		SMLFlags::STRIP_LINK},
+	{"map",			SMLFlags::STRIP_MAP},
+	{"next",		SMLFlags::STRIP_NEXT},
+	{"all",			SMLFlags::STRIP_EXHAUSTIVE},
+	{"parallel",	SMLFlags::STRIP_PARALLEL},
+	{"greedy",		SMLFlags::STRIP_GREEDY},
+};
+
+void addWriteOptions(vector<struct option>& longopts, bool doubles) {
+	static const struct option writeopts[] = {
+		{"comment",		required_argument,	0,	'c'},
+		{"strip",		optional_argument,	0,	's'},
+		{"threads",		required_argument,	0,	't'},
+		{"no-stitch",	no_argument,		0,   2 },
+		{"pack",		optional_argument,	0,   3 },
+		{"strip-budget",	required_argument,	0,   4 },
+		{"reorder",		optional_argument,	0,   5 },
+		{"grid",		no_argument,		0,   6 },
+		{"quantize",	required_argument,	0,   7 },
+		{"varint",		no_argument,		0,   8 },
+		{"compress",	no_argument,		0,   9 },
+		{"predict",		no_argument,		0,  10 },
+		{"edgebreaker",	no_argument,		0,  11 },
+		{"index",		optional_argument,	0,  12 },
+		{"tiles",		optional_argument,	0,  13 },
+		{"lod",			optional_argument,	0,  14 },
+		{"instances",	no_argument,		0,  15 },
+		{"quads",		no_argument,		0,  16 },
+		{"fans",		optional_argument,	0,  17 },
+		{"weld",		required_argument,	0,  19 },
+	};
+	longopts.insert(longopts.end(), begin(writeopts), end(writeopts));
+	if (doubles) longopts.push_back({"double", no_argument, 0, 18});
+}
+
+bool parseWriteOption(int c, const char* optarg, WriteArgs& args) {
+	uint32_t& writeflags = args.flags;
+	SMLOptions& options = args.options;
+	
+	// getopt leaves the = in the -s=mode and -t=n the help shows.
+	if ((c == 's' || c == 't') && optarg && optarg[0] == '=') optarg++;
+	
+	switch (c) {
+		case 'c': {
+			args.comments.emplace_back(optarg);
+		} break;
+		
+		case 's': {
+			uint32_t mode = args.defaultStrip;
+			if (optarg && optarg[0]) {
+				mode = 0;
+				for (auto& strip : stripModes) {
+					if (!strcasecmp(optarg, strip.name)) mode = strip.flag;
+				}
+				if (!mode) {
+					fprintf(stderr, "Error: Unknown strip mode '%s'.\n", optarg);
+					exit(1);
+				}
+			}
+			writeflags = (writeflags & ~SMLFlags::STRIP) | mode;
+		} break;
+		
+		case 't':
+			options.threads = atoi(optarg);
+			break;
+		
+		case 2:
+			options.stitch = false;
+			break;
+		
+		case 3:
+			writeflags |= SMLFlags::PACK_STRIPS;
+			if (optarg && !strcasecmp(optarg, "join")) writeflags |= SMLFlags::JOIN_STRIPS;
+			break;
+		
+		case 4:
+			options.stripBudget = atof(optarg);
+			break;
+		
+		case 5:
+			writeflags &= ~SMLFlags::REORDER;
+			if (optarg && !strcasecmp(optarg, "hilbert")) writeflags |= SMLFlags::REORDER_HILBERT;
+			else if (optarg && !strcasecmp(optarg, "cache")) writeflags |= SMLFlags::REORDER_CACHE;
+			else writeflags |= SMLFlags::REORDER_MORTON;
+			break;
+		
+		case 6:
+			writeflags |= SMLFlags::GRID_VERTICES;
+			break;
+		
+		case 7:
+			writeflags |= SMLFlags::QUANTIZE_VERTICES;
+			if (strchr(optarg, '.')) {
+				options.quantizeBits = 0;
+				options.quantizeError = atof(optarg);
+				if (options.quantizeError <= 0) {
+					fprintf(stderr, "Error: Quantize error must be more than zero.\n");
+					exit(1);
+				}
+			} else {
+				options.quantizeBits = atoi(optarg);
+				if (options.quantizeBits < 10 || options.quantizeBits > 16) {
+					fprintf(stderr, "Error: Quantize bits must be from 10 to 16.\n");
+					exit(1);
+				}
+			}
+			break;
+		
+		case 8:
+			writeflags |= SMLFlags::VARINT_INDICES;
+			break;
+		
+		case 9:
+			writeflags |= SMLFlags::COMPRESS;
+			break;
+		
+		case 10:
+			writeflags |= SMLFlags::PREDICT_VERTICES;
+			break;
+		
+		case 11:
+			writeflags |= SMLFlags::EDGEBREAKER;
+			break;
+		
+		case 12:
+			writeflags |= SMLFlags::INDEX;
+			if (optarg) options.chunkSize = strtoul(optarg, NULL, 10);
+			break;
+		
+		case 13:
+			writeflags |= SMLFlags::TILES;
+			if (optarg) {
+				unsigned int x, y, z;
+				if (sscanf(optarg, "%ux%ux%u", &x, &y, &z) == 3) {
+					options.tiles[0] = x;
+					options.tiles[1] = y;
+					options.tiles[2] = z;
+				} else {
+					options.tiles[0] = options.tiles[1] = 1;
+					options.tiles[2] = atoi(optarg);
+				}
+				if (options.tiles[0] < 1 || options.tiles[1] < 1 || options.tiles[2] < 1
+					|| (uint64_t)options.tiles[0] * options.tiles[1] * options.tiles[2] > 65536) {
+					fprintf(stderr, "Error: Tiles must be from 1 to 65536 in all.\n");
+					exit(1);
+				}
+			}
+			break;
+		
+		case 14:
+			writeflags |= SMLFlags::LEVELS;
+			if (optarg) options.lodLevels = atoi(optarg);
+			if (options.lodLevels < 1 || options.lodLevels > 20) {
+				fprintf(stderr, "Error: LOD levels must be from 1 to 20.\n");
+				exit(1);
+			}
+			break;
+		
+		case 15:
+			writeflags |= SMLFlags::INSTANCES;
+			break;
+		
+		case 16:
+			writeflags |= SMLFlags::QUADS;
+			break;
+		
+		case 17:
+			writeflags |= SMLFlags::FANS;
+			if (optarg) options.fanMin = atoi(optarg);
+			if (options.fanMin < 3) {
+				fprintf(stderr, "Error: Fans need at least 3 triangles.\n");
+				exit(1);
+			}
+			break;
+		
+		case 18:
+			writeflags |= SMLFlags::DOUBLE_VERTICES;
+			break;
+		
+		case 19:
+			args.weld = atof(optarg);
+			if (args.weld <= 0) {
+				fprintf(stderr, "Error: Weld distance must be more than zero.\n");
+				exit(1);
+			}
+			break;
+		
+		default:
+			return false;
+	}
+	return true;
+}
+
+void printWriteHelp(const WriteArgs& args, const char* doubleHelp) {
+	const char* defaultStrip = "";
+	for (auto& strip : stripModes) {
+		if (strip.flag == args.defaultStrip) defaultStrip = strip.name;
+	}
+	
+	printf("-c=<...> --comment=<...>     Add the specified text to the resulting SML file as a comment.\n"
+		"                             Can be used more than once for multiple comments.\n"
+		"-s[=mode] --strip[=mode]     Attempt to find triangle strips in the model.\n"
+		"                             Mode can be one of: link, map, next, all, parallel, greedy (default %s)\n"
+		"                               link: Looks up neighbours through the triangles sharing each vertex.\n"
+		"                               map: Uses a spatial map to check nearby triangles.\n"
+		"                               next: Checks the next 1000 triangles in the source file.\n"
+		"                               all: Does an exhaustive scan of all triangles. Very slow.\n"
+		"                               parallel: Runs link on spatial regions of the model in parallel.\n"
+		"                               greedy: Starts strips from the most isolated triangles first.\n"
+		"-t=<n> --threads=<n>         Number of threads for parallel strip mode.\n"
+		"--no-stitch                  Don't join strips across region borders in parallel strip mode.\n"
+		"--strip-budget=<seconds>     Stop searching for strips after this long, and write the rest as single triangles.\n"
+		"--pack[=join]                Write all strips into one packed strip segment.\n"
+		"                             With join, chains them into one strip using degenerate triangles.\n"
+		"--reorder[=curve]            Sort triangles and vertices along a space-filling curve before writing.\n"
+		"                             Curve can be morton (default) or hilbert. Helps strip search on shuffled input.\n"
+		"                             Or cache, to order triangles for reuse of the vertices a GPU has just transformed\n"
+		"                             instead, for viewers that draw straight from the file. Prints ACMR and ATVR.\n"
+		"--grid                       Store vertices as small integers if their coordinates all sit on a grid.\n"
+		"                             Lossless; falls back to plain floats if no grid is found.\n"
+		"--quantize=<bits|error>      Store vertices with 10 to 16 bits per axis across the bounding box. Lossy.\n"
+		"                             A number with a decimal point is the largest error allowed instead, e.g. 0.01,\n"
+		"                             and if 16 bits can't get within it, vertices are written losslessly instead.\n"
+		"--varint                     Store triangle and strip indices as variable-length deltas. Implies --pack.\n"
+		"--compress                   Entropy code the larger segments.\n"
+		"--predict                    Store vertices as differences from a prediction made along the triangles. Lossless.\n"
+		"                             Works best with --strip, and with --compress to squeeze the differences.\n"
+		"--edgebreaker                Code the triangles of closed, sphere-like parts as Edgebreaker ops.\n"
+		"--index[=chunk]              Add a segment index so readers can check and decode segments in parallel.\n"
+		"                             Splits vertex, triangle and quad lists into chunks of this many (default 262144).\n"
+		"--tiles[=n|XxYxZ]            Group triangles into n slabs along z (default 16), or an X by Y by Z grid of tiles,\n"
+		"                             so readers can load just the part they need.\n"
+		"--lod[=levels]               Write a decimated base mesh first, then refinements back to the full mesh, each\n"
+		"                             doubling the triangles (default 6), so readers can show a preview early.\n"
+		"                             Takes the place of --tiles.\n"
+		"--instances                  Store parts that are moved copies of each other once, with an offset per copy.\n"
+		"                             Not used with --tiles or --lod.\n"
+		"--quads                      Store pairs of triangles that make flat, convex quads as quads, where that's\n"
+		"                             smaller: among the triangles left over from --strip, and not with --varint.\n"
+		"--fans[=min]                 Store runs of at least this many triangles (default 12) around one vertex as fans,\n"
+		"                             among what the strip search leaves. Helps with the caps and holes in CAD exports.\n"
+		"--weld=<distance>            Merge vertices that are within this distance of each other on every axis, so strips\n"
+		"                             can run across the seams sloppy exporters leave. Moves vertices, so lossy.\n"
+		, defaultStrip);
+	if (doubleHelp) printf("--double                     %s", doubleHelp);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,35 @@
+#ifndef CLIOPTS_H
+#define CLIOPTS_H
+
+#include <string>
+#include <vector>
+#include "sml.h"
+
+// What the options shared by the tools that write SML files have asked for.
+struct WriteArgs {
+	uint32_t flags;
+	SMLOptions options;
+	std::vector<std::string> comments;
+	float weld;
+	uint32_t defaultStrip;	// Strip mode for -s without one.
+	
+	WriteArgs(uint32_t defaultStrip) : flags(SMLFlags::NONE), weld(0), defaultStrip(defaultStrip) {}
+};
+
+#ifndef _MSC_VER
+#include <getopt.h>
+
+// Short options for getopt_long to go in front of the tool's own.
+#define WRITE_SHORTOPTS "c:s::t:"
+
+// Adds the writer options to a getopt_long table, with --double if the tool takes it. They use the codes 2 to 19 and
+// the letters in WRITE_SHORTOPTS, so the tool's own options can use 1 and other letters.
+void addWriteOptions(std::vector<struct option>& longopts, bool doubles);
+// Handles one option from getopt_long. Returns false if it isn't a writer option, and exits if its argument is bad.
+bool parseWriteOption(int c, const char* optarg, WriteArgs& args);
+// Prints help for the writer options, after the tool's usage line and before its own options. doubleHelp describes
+// --double for the tool's input, or is NULL if it doesn't take it.
+void printWriteHelp(const WriteArgs& args, const char* doubleHelp);
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,538 @@
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <vector>
+#ifdef USE_SPARSEHASH
+#include <sparsehash/dense_hash_map>
+using namespace google;
+#else
+#include <unordered_map>
+#endif
+
+#include "mesh.h"
+#include "edgebreaker.h"
+using namespace std;
+
+// The CLERS ops. C is stored as a single 0 bit, the rest as a 1 bit followed by these two bits.
+enum EdgebreakerOp {
+	OP_L = 0,
+	OP_R = 1,
+	OP_S = 2,
+	OP_E = 3,
+	OP_C = 4
+};
+
+class BitWriter {
+public:
+	vector<uint8_t>& out;
+	int bit;
+	
+	BitWriter(vector<uint8_t>& o) : out(o), bit(8) {}
+	void put(uint32_t value, int bits) {
+		for (int i = 0; i < bits; i++) {
+			if (bit == 8) {
+				out.push_back(0);
+				bit = 0;
+			}
+			out.back() |= ((value >> i) & 1) << bit;
+			bit++;
+		}
+	}
+};
+
+static void writeOps(const vector<uint8_t>& ops, vector<uint8_t>& out) {
+	BitWriter bits(out);
+	for (uint8_t op : ops) {
+		if (op == OP_C) {
+			bits.put(0, 1);
+		} else {
+			bits.put(1, 1);
+			bits.put(op, 2);
+		}
+	}
+}
+
+// Reads count ops, returning the byte after the last one, or NULL if it runs out.
+static const uint8_t* readOps(const uint8_t* p, const uint8_t* end, size_t count, vector<uint8_t>& ops) {
+	ops.resize(count);
+	int bit = 0;
+	auto get = [&]() -> int {
+		int b = (*p >> bit) & 1;
+		if (++bit == 8) {
+			bit = 0;
+			p++;
+		}
+		return b;
+	};
+	for (size_t i = 0; i < count; i++) {
+		if (p >= end) return NULL;
+		if (!get()) {
+			ops[i] = OP_C;
+			continue;
+		}
+		if (p >= end) return NULL;
+		int op = get();
+		if (p >= end) return NULL;
+		op |= get() << 1;
+		ops[i] = op;
+	}
+	return bit ? p + 1 : p;
+}
+
+// Decodes one component's ops into triangles numbered from base, appending them to out.
+// The boundary between decoded and not yet decoded triangles is kept as a ring of nodes, each one the start of an
+// edge to the next. The gate is the edge the next triangle is built on; S splits the ring in two and carries on with the
+// part after the gate, whose length the encoder didn't store but the ops following it give away:
+// each C adds a node, L and R each remove one, S adds one, and each ring finally closes with an E on 3 nodes.
+static bool decodeComponent(const vector<uint8_t>& ops, uint32_t base, vector<Triangle>& out) {
+	size_t count = ops.size();
+	vector<uint32_t> ringLength(count, 0);
+	{
+		vector<pair<int64_t, int64_t>> open;
+		open.emplace_back(-1, 0);
+		int64_t sum = 0;
+		for (size_t i = 0; i < count; i++) {
+			static const int contrib[5] = { 1, 1, -1, 3, -1 };
+			sum += contrib[ops[i]];
+			if (ops[i] == OP_S) {
+				open.emplace_back(i, sum);
+			} else if (ops[i] == OP_E) {
+				if (open.empty()) return false;
+				if (open.back().first >= 0) {
+					int64_t length = sum - open.back().second;
+					if (length < 3 || length > 0xFFFFFFFF) return false;
+					ringLength[open.back().first] = length;
+				}
+				open.pop_back();
+			}
+		}
+		if (!open.empty() || ops.empty() || ops.back() != OP_E) return false;
+	}
+	
+	vector<uint32_t> vert, next, prev;
+	size_t nodes = 3;
+	for (uint8_t op : ops) {
+		if (op == OP_C || op == OP_S) nodes++;
+	}
+	vert.reserve(nodes);
+	next.reserve(nodes);
+	prev.reserve(nodes);
+	auto node = [&](uint32_t v) -> uint32_t {
+		vert.push_back(v);
+		next.push_back(0);
+		prev.push_back(0);
+		return vert.size() - 1;
+	};
+	
+	// The first triangle is 0 1 2, leaving the ring 1 0 2 behind it.
+	uint32_t newVert = base;
+	out.emplace_back(newVert, newVert + 1, newVert + 2);
+	uint32_t n1 = node(newVert + 1), n0 = node(newVert), n2 = node(newVert + 2);
+	newVert += 3;
+	next[n1] = n0; next[n0] = n2; next[n2] = n1;
+	prev[n0] = n1; prev[n2] = n0; prev[n1] = n2;
+	
+	uint32_t gate = n1;
+	int64_t length = 3;
+	vector<pair<uint32_t, int64_t>> pending;
+	for (size_t i = 0; i < count; i++) {
+		uint32_t g = gate;
+		uint32_t nb = next[g];
+		uint32_t a = vert[g];
+		uint32_t b = vert[nb];
+		
+		switch (ops[i]) {
+			case OP_C: {
+				uint32_t n = node(newVert++);
+				out.emplace_back(a, b, vert[n]);
+				next[g] = n; prev[n] = g;
+				next[n] = nb; prev[nb] = n;
+				gate = n;
+				length++;
+			} break;
+			
+			case OP_L: {
+				uint32_t p = prev[g];
+				if (length <= 3) return false;
+				out.emplace_back(a, b, vert[p]);
+				next[p] = nb; prev[nb] = p;
+				gate = p;
+				length--;
+			} break;
+			
+			case OP_R: {
+				uint32_t n = next[nb];
+				if (length <= 3) return false;
+				out.emplace_back(a, b, vert[n]);
+				next[g] = n; prev[n] = g;
+				length--;
+			} break;
+			
+			case OP_S: {
+				// The tip is (ring length) nodes on from the gate; walk whichever way round is shorter.
+				int64_t forward = ringLength[i];
+				if (forward > length - 2) return false;
+				uint32_t nv;
+				if (forward - 1 <= length - forward) {
+					nv = nb;
+					for (int64_t k = 1; k < forward; k++) nv = next[nv];
+				} else {
+					nv = g;
+					for (int64_t k = 0; k < length - forward; k++) nv = prev[nv];
+				}
+				uint32_t y = next[nv];
+				out.emplace_back(a, b, vert[nv]);
+				
+				uint32_t nv2 = node(vert[nv]);
+				next[nv] = nb; prev[nb] = nv;
+				next[g] = nv2; prev[nv2] = g;
+				next[nv2] = y; prev[y] = nv2;
+				pending.emplace_back(g, length + 1 - forward);
+				gate = nv;
+				length = forward;
+			} break;
+			
+			case OP_E: {
+				if (length != 3) return false;
+				out.emplace_back(a, b, vert[prev[g]]);
+				if (pending.empty()) return i == count - 1;
+				gate = pending.back().first;
+				length = pending.back().second;
+				pending.pop_back();
+			} break;
+		}
+	}
+	return false;
+}
+
+
+size_t edgebreakerEncode(Mesh* mesh, vector<uint32_t>& order, vector<shared_ptr<Triangle>>& rest, vector<uint8_t>& payload) {
+	size_t triCount = mesh->t.size();
+	size_t vertCount = mesh->v.size();
+	order.clear();
+	rest.clear();
+	payload.clear();
+	
+	printf("Building half-edges...");
+	fflush(stdout);
+	// Half-edge 3t+k runs from corner k of triangle t to corner k+1.
+	const uint32_t NONE = 0xFFFFFFFF;
+	vector<uint32_t> twin(triCount * 3, NONE);
+	vector<uint8_t> bad(triCount, 0);
+	{
+		#ifdef USE_SPARSEHASH
+		dense_hash_map<uint64_t, uint32_t> edges(triCount * 3);
+		edges.set_empty_key(0xFFFFFFFFFFFFFFFFull);
+		#else
+		unordered_map<uint64_t, uint32_t> edges;
+		edges.reserve(triCount * 3);
+		#endif
+		for (size_t t = 0; t < triCount; t++) {
+			Triangle* tri = mesh->t[t].get();
+			if (tri->a == tri->b || tri->b == tri->c || tri->c == tri->a) {
+				bad[t] = 1;
+				continue;
+			}
+			for (int k = 0; k < 3; k++) {
+				auto ins = edges.insert(make_pair(((uint64_t)tri->v[k] << 32) | tri->v[(k+1) % 3], (uint32_t)(t*3 + k)));
+				if (!ins.second) {
+					// The same edge twice the same way round: non-manifold, or flipped neighbours.
+					bad[t] = 1;
+					bad[ins.first->second / 3] = 1;
+				}
+			}
+		}
+		for (size_t t = 0; t < triCount; t++) {
+			if (bad[t]) continue;
+			Triangle* tri = mesh->t[t].get();
+			for (int k = 0; k < 3; k++) {
+				auto i = edges.find(((uint64_t)tri->v[(k+1) % 3] << 32) | tri->v[k]);
+				if (i != edges.end() && !bad[i->second / 3]) twin[t*3 + k] = i->second;
+			}
+		}
+	}
+	printf("Done.\n");
+	
+	printf("Finding closed components...");
+	fflush(stdout);
+	// Components, by flood fill across twins. Any open edge or bad triangle spoils the whole component.
+	vector<uint32_t> component(triCount, NONE);
+	vector<vector<uint32_t>> components;
+	vector<uint8_t> usable;
+	for (size_t seed = 0; seed < triCount; seed++) {
+		if (component[seed] != NONE) continue;
+		uint32_t id = components.size();
+		components.emplace_back();
+		vector<uint32_t>& tris = components.back();
+		bool ok = true;
+		tris.push_back(seed);
+		component[seed] = id;
+		for (size_t i = 0; i < tris.size(); i++) {
+			uint32_t t = tris[i];
+			if (bad[t]) ok = false;
+			for (int k = 0; k < 3; k++) {
+				uint32_t tw = twin[t*3 + k];
+				if (tw == NONE) {
+					ok = false;
+					continue;
+				}
+				if (component[tw / 3] == NONE) {
+					component[tw / 3] = id;
+					tris.push_back(tw / 3);
+				}
+			}
+		}
+		usable.push_back(ok);
+	}
+	
+	// Every vertex has to belong to just one component, since each one's vertices get numbered as a block.
+	vector<uint32_t> owner(vertCount, NONE);
+	for (size_t t = 0; t < triCount; t++) {
+		for (uint32_t v : mesh->t[t]->v) {
+			if (owner[v] == NONE) owner[v] = component[t];
+			else if (owner[v] != component[t] && owner[v] != NONE - 1) {
+				usable[owner[v]] = 0;
+				usable[component[t]] = 0;
+				owner[v] = NONE - 1;
+			} else if (owner[v] == NONE - 1) {
+				usable[component[t]] = 0;
+			}
+		}
+	}
+	for (auto& q : mesh->q) {
+		for (uint32_t v : q->v) {
+			if (owner[v] < components.size()) usable[owner[v]] = 0;
+		}
+	}
+	
+	// Genus 0: V - E + F = 2.
+	vector<uint32_t> count(components.size(), 0);
+	for (size_t v = 0; v < vertCount; v++) {
+		if (owner[v] < components.size()) count[owner[v]]++;
+	}
+	for (size_t c = 0; c < components.size(); c++) {
+		size_t f = components[c].size();
+		if (usable[c] && (int64_t)count[c] - (int64_t)(f * 3 / 2) + (int64_t)f != 2) usable[c] = 0;
+	}
+	printf("Done.\n");
+	
+	printf("Encoding connectivity...");
+	fflush(stdout);
+	vector<uint8_t> conquered(triCount, 0);
+	vector<uint8_t> visited(vertCount, 0);
+	vector<uint32_t> heNode(triCount * 3, NONE);
+	vector<uint32_t> vert, next, prev, nodeHe;
+	vector<uint32_t> local(vertCount, NONE);
+	vector<uint8_t> ops;
+	vector<Triangle> emitted, decoded;
+	vector<uint32_t> compOrder;
+	
+	vector<uint8_t> header(4), streams;
+	uint32_t accepted = 0;
+	size_t covered = 0;
+	vector<uint8_t> keep(triCount, 0);
+	
+	for (size_t c = 0; c < components.size(); c++) {
+		if (!usable[c]) continue;
+		vector<uint32_t>& tris = components[c];
+		
+		vert.clear(); next.clear(); prev.clear(); nodeHe.clear();
+		ops.clear(); emitted.clear(); compOrder.clear();
+		auto node = [&](uint32_t v, uint32_t he) -> uint32_t {
+			vert.push_back(v);
+			next.push_back(0);
+			prev.push_back(0);
+			nodeHe.push_back(he);
+			heNode[he] = vert.size() - 1;
+			return vert.size() - 1;
+		};
+		auto visit = [&](uint32_t v) {
+			visited[v] = 1;
+			local[v] = compOrder.size();
+			compOrder.push_back(v);
+		};
+		
+		uint32_t t0 = tris[0];
+		Triangle* first = mesh->t[t0].get();
+		conquered[t0] = 1;
+		visit(first->a);
+		visit(first->b);
+		visit(first->c);
+		emitted.emplace_back(first->a, first->b, first->c);
+		uint32_t ny = node(first->b, twin[t0*3]);
+		uint32_t nx = node(first->a, twin[t0*3 + 2]);
+		uint32_t nz = node(first->c, twin[t0*3 + 1]);
+		next[ny] = nx; next[nx] = nz; next[nz] = ny;
+		prev[nx] = ny; prev[nz] = nx; prev[ny] = nz;
+		
+		uint32_t gate = ny;
+		vector<uint32_t> pending;
+		bool ok = true;
+		while (ok) {
+			uint32_t g = gate;
+			uint32_t nb = next[g];
+			uint32_t h = nodeHe[g];
+			uint32_t t = h / 3;
+			if (conquered[t]) {
+				ok = false;
+				break;
+			}
+			uint32_t k = h % 3;
+			uint32_t hb = t*3 + (k+1) % 3;
+			uint32_t hv = t*3 + (k+2) % 3;
+			uint32_t v = mesh->t[t]->v[(k+2) % 3];
+			bool left = nodeHe[prev[g]] == hv;
+			bool right = nodeHe[nb] == hb;
+			
+			conquered[t] = 1;
+			heNode[h] = NONE;
+			emitted.emplace_back(vert[g], vert[nb], v);
+			
+			if (!visited[v]) {
+				if (left || right) {
+					ok = false;
+					break;
+				}
+				ops.push_back(OP_C);
+				visit(v);
+				uint32_t n = node(v, twin[hb]);
+				nodeHe[g] = twin[hv];
+				heNode[twin[hv]] = g;
+				next[g] = n; prev[n] = g;
+				next[n] = nb; prev[nb] = n;
+				gate = n;
+			} else if (left && right) {
+				ops.push_back(OP_E);
+				heNode[hv] = heNode[hb] = NONE;
+				if (pending.empty()) break;
+				gate = pending.back();
+				pending.pop_back();
+			} else if (left) {
+				ops.push_back(OP_L);
+				uint32_t p = prev[g];
+				heNode[hv] = NONE;
+				nodeHe[p] = twin[hb];
+				heNode[twin[hb]] = p;
+				next[p] = nb; prev[nb] = p;
+				gate = p;
+			} else if (right) {
+				ops.push_back(OP_R);
+				uint32_t n = next[nb];
+				heNode[hb] = NONE;
+				nodeHe[g] = twin[hv];
+				heNode[twin[hv]] = g;
+				next[g] = n; prev[n] = g;
+			} else {
+				ops.push_back(OP_S);
+				// Find where the tip is on the ring: turn around it from this triangle, through triangles not done yet,
+				// until reaching an edge out of it that's on the ring.
+				uint32_t cur = hv;
+				uint32_t nv = NONE;
+				for (size_t steps = 0; steps < tris.size(); steps++) {
+					uint32_t tw = twin[cur];
+					if (tw / 3 == t || conquered[tw / 3]) break;
+					cur = (tw / 3) * 3 + (tw % 3 + 1) % 3;
+					if (heNode[cur] != NONE) {
+						nv = heNode[cur];
+						break;
+					}
+				}
+				if (nv == NONE) {
+					ok = false;
+					break;
+				}
+				
+				uint32_t y = next[nv];
+				uint32_t nv2 = node(v, nodeHe[nv]);
+				nodeHe[nv] = twin[hb];
+				heNode[twin[hb]] = nv;
+				next[nv] = nb; prev[nb] = nv;
+				nodeHe[g] = twin[hv];
+				heNode[twin[hv]] = g;
+				next[g] = nv2; prev[nv2] = g;
+				next[nv2] = y; prev[y] = nv2;
+				pending.push_back(g);
+				gate = nv;
+			}
+		}
+		
+		for (uint32_t t : tris) {
+			conquered[t] = 0;
+			heNode[t*3] = heNode[t*3 + 1] = heNode[t*3 + 2] = NONE;
+		}
+		for (uint32_t v : compOrder) visited[v] = 0;
+		if (!ok || emitted.size() != tris.size()) continue;
+		
+		// Check it decodes to exactly what was encoded before keeping it. This is what catches the shapes that
+		// passed the checks above but still aren't a plain sphere, like two surfaces pinched together at a vertex.
+		uint32_t base = order.size();
+		decoded.clear();
+		if (!decodeComponent(ops, base, decoded) || decoded.size() != emitted.size()) continue;
+		bool same = true;
+		for (size_t i = 0; i < emitted.size() && same; i++) {
+			for (int k = 0; k < 3; k++) {
+				if (decoded[i].v[k] != base + local[emitted[i].v[k]]) same = false;
+			}
+		}
+		if (!same) continue;
+		
+		order.insert(order.end(), compOrder.begin(), compOrder.end());
+		uint32_t opCount = ops.size();
+		header.insert(header.end(), (uint8_t*)&base, (uint8_t*)&base + 4);
+		header.insert(header.end(), (uint8_t*)&opCount, (uint8_t*)&opCount + 4);
+		writeOps(ops, streams);
+		for (uint32_t t : tris) keep[t] = 1;
+		covered += tris.size();
+		accepted++;
+	}
+	
+	if (accepted == 0) {
+		printf("nothing suitable.\n");
+		order.clear();
+		return 0;
+	}
+	
+	memcpy(&header[0], &accepted, 4);
+	payload.swap(header);
+	payload.insert(payload.end(), streams.begin(), streams.end());
+	
+	// Everything else keeps its place, after the coded vertices.
+	vector<uint8_t> placed(vertCount, 0);
+	for (uint32_t v : order) placed[v] = 1;
+	for (size_t v = 0; v < vertCount; v++) {
+		if (!placed[v]) order.push_back(v);
+	}
+	for (size_t t = 0; t < triCount; t++) {
+		if (!keep[t]) rest.push_back(mesh->t[t]);
+	}
+	printf("%u components, %lu of %lu triangles, %.2f bits each.\n", accepted, (unsigned long)covered,
+		(unsigned long)triCount, payload.size() * 8.0 / covered);
+	return covered;
+}
+
+bool edgebreakerDecode(Mesh* mesh, const uint8_t* payload, size_t length) {
+	if (length < 4) return false;
+	uint32_t components;
+	memcpy(&components, payload, 4);
+	if (length < 4 + (size_t)components * 8) return false;
+	const uint8_t* p = payload + 4 + (size_t)components * 8;
+	const uint8_t* end = payload + length;
+	
+	vector<uint8_t> ops;
+	vector<Triangle> tris;
+	for (uint32_t c = 0; c < components; c++) {
+		uint32_t base, opCount;
+		memcpy(&base, payload + 4 + c*8, 4);
+		memcpy(&opCount, payload + 8 + c*8, 4);
+		p = readOps(p, end, opCount, ops);
+		if (!p) return false;
+		tris.clear();
+		if (!decodeComponent(ops, base, tris)) return false;
+		mesh->t.reserve(mesh->t.size() + tris.size());
+		for (Triangle& t : tris) {
+			mesh->t.push_back(make_shared<Triangle>(t));
+		}
+	}
+	return p == end;
+}
@@ -0,0 +1,15 @@
+#ifndef EDGEBREAKER_H
+#define EDGEBREAKER_H
+
+#include "config.h"
+#include <vector>
+#include "mesh.h"
+
+// Edgebreaker connectivity coding (Rossignac 1999) for the closed, manifold, genus 0 parts of a mesh.
+// Fills order with a new vertex order to give to permuteVertices, rest with the triangles it couldn't code, and payload
+// with a type 13 segment in terms of the new order. Returns how many triangles it coded.
+size_t edgebreakerEncode(Mesh* mesh, std::vector<uint32_t>& order, std::vector<std::shared_ptr<Triangle>>& rest, std::vector<uint8_t>& payload);
+// Decodes a type 13 segment, adding its triangles to the mesh. Returns false if it's malformed.
+bool edgebreakerDecode(Mesh* mesh, const uint8_t* payload, size_t length);
+
+#endif
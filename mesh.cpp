@@ -1,4 +1,6 @@
 #include "mesh.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <algorithm>
 using namespace std;
 
@@ -17,6 +19,10 @@ static inline uint32_t findVertex(Mesh* mesh, shared_ptr<Vertex> v) {
 	}
 	*/
 
+	if (mesh->v.size() >= SML_MAX_VERTICES) {
+		fprintf(stderr, "Error: More than %llu vertices, which 32-bit indices can't reach.\n", SML_MAX_VERTICES);
+		exit(__LINE__);
+	}
 	uint32_t ret = mesh->v.size();
 	mesh->add(v);
 	#ifdef USE_SPARSEHASH
@@ -68,6 +68,18 @@ public:
 	}
 };
 
+// A vertex that also keeps the double-precision coordinates it was read with, for meshes with precise set.
+class PreciseVertex : public Vertex {
+public:
+	double d[3];
+	
+	PreciseVertex(double X, double Y, double Z) : Vertex(X, Y, Z) {
+		d[0] = X;
+		d[1] = Y;
+		d[2] = Z;
+	}
+};
+
 
 class VertexPtrHash {
 public:
@@ -89,6 +101,8 @@ public:
 
 
 
+// Indices are 32 bits, so that's as many vertices as a mesh can have.
+#define SML_MAX_VERTICES 0x100000000ull
 
 class Triangle {
 public:
@@ -171,6 +185,21 @@ public:
 
 
 
+// Interleaves the low 21 bits of x, y and z into a 63-bit Morton (Z-order) code.
+static inline uint64_t mortonSpread(uint32_t v) {
+	uint64_t x = v & 0x1FFFFF;
+	x = (x | (x << 32)) & 0x001F00000000FFFFull;
+	x = (x | (x << 16)) & 0x001F0000FF0000FFull;
+	x = (x | (x << 8))  & 0x100F00F00F00F00Full;
+	x = (x | (x << 4))  & 0x10C30C30C30C30C3ull;
+	x = (x | (x << 2))  & 0x1249249249249249ull;
+	return x;
+}
+static inline uint64_t mortonCode(uint32_t x, uint32_t y, uint32_t z) {
+	return mortonSpread(x) | (mortonSpread(y) << 1) | (mortonSpread(z) << 2);
+}
+
+
 class Mesh;
 
 class SpatialMap {
@@ -227,6 +256,8 @@ public:
 	std::vector<std::shared_ptr<Triangle>> t;
 	std::vector<std::shared_ptr<Quad>> q;
 	std::vector<std::string> comments;
+	bool precise;	// Every vertex is a PreciseVertex.
+	size_t rounded;	// Vertices that were read as doubles and lost precision as floats.
 	
 	SpatialMap spatialMap;
 	#ifdef USE_SPARSEHASH
@@ -238,6 +269,8 @@ public:
 	Mesh() {
 		minX = minY = minZ = std::numeric_limits<float>::max();
 		maxX = maxY = maxZ = -std::numeric_limits<float>::max();
+		precise = false;
+		rounded = 0;
 		spatialMap.init(this);
 		
 		#ifdef USE_SPARSEHASH
@@ -253,6 +286,19 @@ public:
 		if (V->z > maxZ) maxZ = V->z;
 		v.push_back(V);
 	}
+	// Recomputes the bounds from the vertex list, for meshes that didn't come in through add().
+	void updateBounds() {
+		minX = minY = minZ = std::numeric_limits<float>::max();
+		maxX = maxY = maxZ = -std::numeric_limits<float>::max();
+		for (auto& V : v) {
+			if (V->x < minX) minX = V->x;
+			if (V->x > maxX) maxX = V->x;
+			if (V->y < minY) minY = V->y;
+			if (V->y > maxY) maxY = V->y;
+			if (V->z < minZ) minZ = V->z;
+			if (V->z > maxZ) maxZ = V->z;
+		}
+	}
 	inline void add(std::shared_ptr<Triangle> T) {
 		t.push_back(T);
 	}
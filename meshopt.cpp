@@ -0,0 +1,1005 @@
+#include <stdio.h>
+#include <assert.h>
+#include <limits>
+#include <algorithm>
+#include <thread>
+#include <queue>
+#include <unordered_map>
+
+#include "mesh.h"
+#include "meshopt.h"
+using namespace std;
+
+void permuteVertices(Mesh* mesh, const vector<uint32_t>& order) {
+	vector<uint32_t> remap(mesh->v.size(), 0xFFFFFFFF);
+	vector<shared_ptr<Vertex>> verts;
+	verts.reserve(order.size());
+	for (uint32_t i = 0; i < order.size(); i++) {
+		remap[order[i]] = i;
+		verts.push_back(mesh->v[order[i]]);
+	}
+	mesh->v.swap(verts);
+	
+	for (auto& t : mesh->t) {
+		for (uint32_t& i : t->v) {
+			i = remap[i];
+		}
+	}
+	for (auto& q : mesh->q) {
+		for (uint32_t& i : q->v) {
+			i = remap[i];
+		}
+	}
+}
+
+
+// Hilbert index of a point, using John Skilling's transpose method ("Programming the Hilbert curve", 2004).
+static uint64_t hilbertCode(uint32_t x, uint32_t y, uint32_t z, int bits) {
+	uint32_t X[3] = { x, y, z };
+	uint32_t M = 1u << (bits - 1);
+	
+	// Inverse undo
+	for (uint32_t Q = M; Q > 1; Q >>= 1) {
+		uint32_t P = Q - 1;
+		for (int i = 0; i < 3; i++) {
+			if (X[i] & Q) {
+				X[0] ^= P;
+			} else {
+				uint32_t t = (X[0] ^ X[i]) & P;
+				X[0] ^= t;
+				X[i] ^= t;
+			}
+		}
+	}
+	
+	// Gray encode
+	X[1] ^= X[0];
+	X[2] ^= X[1];
+	uint32_t t = 0;
+	for (uint32_t Q = M; Q > 1; Q >>= 1) {
+		if (X[2] & Q) t ^= Q - 1;
+	}
+	for (int i = 0; i < 3; i++) {
+		X[i] ^= t;
+	}
+	
+	// The transposed form has X[0] as the most significant bit of each group of 3.
+	return mortonCode(X[2], X[1], X[0]);
+}
+
+// Stable LSD radix sort of values by the low (bits) bits of keys, 8 bits per pass.
+// Each thread counts and scatters its own slice, so the passes run in parallel.
+static void radixSort(vector<uint64_t>& keys, vector<uint32_t>& values, int bits, unsigned int threads) {
+	size_t count = keys.size();
+	if (threads < 1) threads = 1;
+	if (count < (size_t)threads * 65536) threads = 1;
+	
+	vector<uint64_t> keys2(count);
+	vector<uint32_t> values2(count);
+	vector<size_t> histogram(threads * 256);
+	
+	for (int shift = 0; shift < bits; shift += 8) {
+		fill(histogram.begin(), histogram.end(), 0);
+		auto slice = [&](unsigned int t, size_t* begin, size_t* end) {
+			*begin = count * t / threads;
+			*end = count * (t+1) / threads;
+		};
+		
+		vector<thread> workers;
+		for (unsigned int t = 0; t < threads; t++) {
+			workers.emplace_back([&, t]() {
+				size_t begin, end;
+				slice(t, &begin, &end);
+				size_t* h = &histogram[t * 256];
+				for (size_t i = begin; i < end; i++) {
+					h[(keys[i] >> shift) & 0xFF]++;
+				}
+			});
+		}
+		for (auto& worker : workers) worker.join();
+		workers.clear();
+		
+		// Every key has the same digit, nothing to do for this pass.
+		bool trivial = false;
+		for (int digit = 0; digit < 256 && !trivial; digit++) {
+			size_t n = 0;
+			for (unsigned int t = 0; t < threads; t++) {
+				n += histogram[t * 256 + digit];
+			}
+			if (n == count) trivial = true;
+		}
+		if (trivial) continue;
+		
+		// Turn the counts into starting offsets, ordered by digit and then by thread to keep it stable.
+		size_t offset = 0;
+		for (int digit = 0; digit < 256; digit++) {
+			for (unsigned int t = 0; t < threads; t++) {
+				size_t n = histogram[t * 256 + digit];
+				histogram[t * 256 + digit] = offset;
+				offset += n;
+			}
+		}
+		for (unsigned int t = 0; t < threads; t++) {
+			workers.emplace_back([&, t]() {
+				size_t begin, end;
+				slice(t, &begin, &end);
+				size_t* h = &histogram[t * 256];
+				for (size_t i = begin; i < end; i++) {
+					size_t pos = h[(keys[i] >> shift) & 0xFF]++;
+					keys2[pos] = keys[i];
+					values2[pos] = values[i];
+				}
+			});
+		}
+		for (auto& worker : workers) worker.join();
+		
+		keys.swap(keys2);
+		values.swap(values2);
+	}
+}
+
+void reorderTriangles(Mesh* mesh, bool hilbert, unsigned int threads) {
+	size_t triCount = mesh->t.size();
+	if (triCount == 0) return;
+	
+	printf("Sorting %lu triangles along a %s curve...", (unsigned long)triCount, hilbert ? "Hilbert" : "Morton");
+	fflush(stdout);
+	
+	float lo[3] = { numeric_limits<float>::max(), numeric_limits<float>::max(), numeric_limits<float>::max() };
+	float hi[3] = { -numeric_limits<float>::max(), -numeric_limits<float>::max(), -numeric_limits<float>::max() };
+	vector<float> centroids(triCount * 3);
+	for (size_t i = 0; i < triCount; i++) {
+		Triangle* t = mesh->t[i].get();
+		Vertex* a = mesh->v[t->a].get();
+		Vertex* b = mesh->v[t->b].get();
+		Vertex* c = mesh->v[t->c].get();
+		for (int axis = 0; axis < 3; axis++) {
+			float f = (a->c[axis] + b->c[axis] + c->c[axis]) / 3.0f;
+			centroids[i*3 + axis] = f;
+			if (f < lo[axis]) lo[axis] = f;
+			if (f > hi[axis]) hi[axis] = f;
+		}
+	}
+	
+	// 16 bits per axis is far finer than any triangle soup needs for locality, and keeps it to 6 radix passes.
+	const int bits = 16;
+	vector<uint64_t> keys(triCount);
+	vector<uint32_t> values(triCount);
+	for (size_t i = 0; i < triCount; i++) {
+		uint32_t q[3];
+		for (int axis = 0; axis < 3; axis++) {
+			float range = hi[axis] - lo[axis];
+			q[axis] = range > 0 ? (uint32_t)((centroids[i*3 + axis] - lo[axis]) / range * 65535.0f) : 0;
+		}
+		keys[i] = hilbert ? hilbertCode(q[0], q[1], q[2], bits) : mortonCode(q[0], q[1], q[2]);
+		values[i] = i;
+	}
+	centroids.clear();
+	
+	radixSort(keys, values, bits * 3, threads);
+	
+	vector<shared_ptr<Triangle>> tris;
+	tris.reserve(triCount);
+	for (uint32_t i : values) {
+		tris.push_back(mesh->t[i]);
+	}
+	mesh->t.swap(tris);
+	printf("Done.\n");
+}
+
+void renumberVertices(Mesh* mesh) {
+	printf("Renumbering vertices...");
+	fflush(stdout);
+	
+	vector<bool> seen(mesh->v.size(), false);
+	vector<uint32_t> order;
+	order.reserve(mesh->v.size());
+	for (auto& t : mesh->t) {
+		for (uint32_t i : t->v) {
+			if (!seen[i]) {
+				seen[i] = true;
+				order.push_back(i);
+			}
+		}
+	}
+	for (auto& q : mesh->q) {
+		for (uint32_t i : q->v) {
+			if (!seen[i]) {
+				seen[i] = true;
+				order.push_back(i);
+			}
+		}
+	}
+	// Keep anything unreferenced, at the end. Getting rid of those is a different job.
+	for (uint32_t i = 0; i < mesh->v.size(); i++) {
+		if (!seen[i]) order.push_back(i);
+	}
+	
+	permuteVertices(mesh, order);
+	printf("Done.\n");
+}
+
+
+void decimate(Mesh* mesh, size_t target, vector<Triangle>& tris, vector<uint8_t>& alive, vector<EdgeCollapse>& collapses) {
+	printf("Decimating to %u triangles...", (uint32_t)target);
+	fflush(stdout);
+	size_t vertCount = mesh->v.size();
+	size_t triCount = mesh->t.size();
+	tris.resize(triCount);
+	alive.assign(triCount, 1);
+	collapses.clear();
+	
+	vector<vector<uint32_t>> around(vertCount);
+	vector<uint8_t> locked(vertCount, 0);
+	for (uint32_t i = 0; i < triCount; i++) {
+		tris[i] = *mesh->t[i];
+		Triangle& t = tris[i];
+		if (t.a == t.b || t.b == t.c || t.c == t.a) {
+			locked[t.a] = locked[t.b] = locked[t.c] = 1;
+		}
+		for (uint32_t v : t.v) around[v].push_back(i);
+	}
+	for (auto& q : mesh->q) {
+		for (uint32_t v : q->v) locked[v] = 1;
+	}
+	
+	auto distance2 = [&](uint32_t a, uint32_t b) -> float {
+		const float* p = mesh->v[a]->c;
+		const float* q = mesh->v[b]->c;
+		return (p[0]-q[0])*(p[0]-q[0]) + (p[1]-q[1])*(p[1]-q[1]) + (p[2]-q[2])*(p[2]-q[2]);
+	};
+	auto normal = [&](uint32_t a, uint32_t b, uint32_t c, const float* moved, uint32_t which, double* n) {
+		const float* p[3] = { mesh->v[a]->c, mesh->v[b]->c, mesh->v[c]->c };
+		if (a == which) p[0] = moved;
+		if (b == which) p[1] = moved;
+		if (c == which) p[2] = moved;
+		double u[3], w[3];
+		for (int k = 0; k < 3; k++) {
+			u[k] = (double)p[1][k] - p[0][k];
+			w[k] = (double)p[2][k] - p[0][k];
+		}
+		n[0] = u[1]*w[2] - u[2]*w[1];
+		n[1] = u[2]*w[0] - u[0]*w[2];
+		n[2] = u[0]*w[1] - u[1]*w[0];
+	};
+	auto neighbours = [&](uint32_t v, vector<uint32_t>& out) {
+		out.clear();
+		for (uint32_t t : around[v]) {
+			for (uint32_t w : tris[t].v) {
+				if (w != v) out.push_back(w);
+			}
+		}
+		sort(out.begin(), out.end());
+		out.erase(unique(out.begin(), out.end()), out.end());
+	};
+	// A vertex is on a boundary if one of its edges only has one triangle.
+	auto onBoundary = [&](uint32_t v) -> bool {
+		for (uint32_t t : around[v]) {
+			for (int k = 0; k < 3; k++) {
+				uint32_t w = tris[t].v[k];
+				if (w == v) continue;
+				int count = 0;
+				for (uint32_t t2 : around[v]) {
+					const Triangle& o = tris[t2];
+					if (o.a == w || o.b == w || o.c == w) count++;
+				}
+				if (count == 1) return true;
+			}
+		}
+		return false;
+	};
+	
+	// Edges shortest first. Entries aren't removed when things change; they're checked again when they come up.
+	typedef pair<float, pair<uint32_t, uint32_t>> Edge;
+	priority_queue<Edge, vector<Edge>, greater<Edge>> queue;
+	for (uint32_t i = 0; i < triCount; i++) {
+		const Triangle& t = tris[i];
+		for (int k = 0; k < 3; k++) {
+			uint32_t a = t.v[k], b = t.v[(k+1) % 3];
+			if (a < b) queue.push(Edge(distance2(a, b), make_pair(a, b)));
+		}
+	}
+	
+	size_t left = triCount;
+	vector<uint32_t> nu, nv, shared, opposite;
+	while (left > target && !queue.empty()) {
+		uint32_t a = queue.top().second.first;
+		uint32_t b = queue.top().second.second;
+		queue.pop();
+		
+		// Still an edge? Each triangle on it has the third vertex in opposite.
+		opposite.clear();
+		for (uint32_t t : around[a]) {
+			const Triangle& o = tris[t];
+			for (int k = 0; k < 3; k++) {
+				if (o.v[k] == b) opposite.push_back(o.a ^ o.b ^ o.c ^ a ^ b);
+			}
+		}
+		if (opposite.empty() || opposite.size() > 2) continue;
+		sort(opposite.begin(), opposite.end());
+		
+		// Link condition: the only vertices next to both ends are the ones across from the edge, or the collapse
+		// would pinch the surface.
+		neighbours(a, nu);
+		neighbours(b, nv);
+		shared.clear();
+		set_intersection(nu.begin(), nu.end(), nv.begin(), nv.end(), back_inserter(shared));
+		if (shared != opposite) continue;
+		
+		// Try moving a onto b, then b onto a. The one that moves mustn't be locked, mustn't pull a boundary in along an
+		// inside edge, and mustn't turn any of its other triangles over.
+		uint32_t u = 0xFFFFFFFF, v = 0;
+		for (int dir = 0; dir < 2 && u == 0xFFFFFFFF; dir++) {
+			uint32_t from = dir ? b : a, to = dir ? a : b;
+			if (locked[from]) continue;
+			if (opposite.size() == 2 && onBoundary(from)) continue;
+			bool ok = true;
+			for (uint32_t t : around[from]) {
+				const Triangle& o = tris[t];
+				if (o.a == to || o.b == to || o.c == to) continue;
+				double before[3], after[3];
+				normal(o.a, o.b, o.c, mesh->v[from]->c, from, before);
+				normal(o.a, o.b, o.c, mesh->v[to]->c, from, after);
+				double dot = before[0]*after[0] + before[1]*after[1] + before[2]*after[2];
+				if (dot <= 0) {
+					ok = false;
+					break;
+				}
+			}
+			if (ok) {
+				u = from;
+				v = to;
+			}
+		}
+		if (u == 0xFFFFFFFF) continue;
+		
+		EdgeCollapse collapse;
+		collapse.u = u;
+		collapse.v = v;
+		for (uint32_t t : around[u]) {
+			Triangle& o = tris[t];
+			if (o.a == v || o.b == v || o.c == v) {
+				collapse.removed.push_back(t);
+				alive[t] = 0;
+				left--;
+				for (uint32_t w : o.v) {
+					if (w == u) continue;
+					auto& list = around[w];
+					list.erase(find(list.begin(), list.end(), t));
+				}
+			} else {
+				collapse.changed.push_back(t);
+				for (uint32_t& w : o.v) {
+					if (w == u) w = v;
+				}
+				around[v].push_back(t);
+			}
+		}
+		around[u].clear();
+		for (uint32_t t : around[v]) {
+			for (uint32_t w : tris[t].v) {
+				if (w != v) queue.push(Edge(distance2(v, w), make_pair(min(v, w), max(v, w))));
+			}
+		}
+		collapses.push_back(move(collapse));
+	}
+	printf("%u left after %u collapses.\n", (uint32_t)left, (uint32_t)collapses.size());
+}
+
+
+void findInstances(Mesh* mesh, vector<InstanceGroup>& groups, vector<uint8_t>& instanced) {
+	printf("Looking for repeated parts...");
+	fflush(stdout);
+	size_t vertCount = mesh->v.size();
+	size_t triCount = mesh->t.size();
+	groups.clear();
+	instanced.assign(triCount, 0);
+	
+	// Connected parts, by union-find over the vertices each triangle joins.
+	vector<uint32_t> parent(vertCount);
+	for (uint32_t i = 0; i < vertCount; i++) parent[i] = i;
+	auto root = [&](uint32_t x) {
+		while (parent[x] != x) {
+			parent[x] = parent[parent[x]];
+			x = parent[x];
+		}
+		return x;
+	};
+	for (auto& t : mesh->t) {
+		uint32_t a = root(t->a);
+		for (int k = 1; k < 3; k++) {
+			uint32_t b = root(t->v[k]);
+			if (b != a) parent[b] = a;
+		}
+	}
+	vector<uint32_t> partOf(vertCount, 0xFFFFFFFF);
+	vector<vector<uint32_t>> parts;
+	for (uint32_t i = 0; i < triCount; i++) {
+		uint32_t r = root(mesh->t[i]->a);
+		if (partOf[r] == 0xFFFFFFFF) {
+			partOf[r] = parts.size();
+			parts.emplace_back();
+		}
+		parts[partOf[r]].push_back(i);
+	}
+	vector<uint8_t> usable(parts.size(), parts.size() > 1);
+	for (auto& q : mesh->q) {
+		for (uint32_t v : q->v) {
+			uint32_t r = root(v);
+			if (partOf[r] != 0xFFFFFFFF) usable[partOf[r]] = 0;
+		}
+	}
+	
+	// Each part's vertices in the order its triangles first use them, and its corners in those terms. Copies made by
+	// duplicating a part come out the same, so these are hashed to find the candidates, then the coordinates are checked.
+	struct Shape {
+		uint32_t part;
+		vector<uint32_t> verts, corners;
+		uint32_t far[3];	// The vertex furthest out on each axis.
+		vector<uint32_t> copies;
+		vector<Vertex> offsets;
+	};
+	vector<Shape> shapes;
+	unordered_map<uint64_t, vector<uint32_t>> buckets;
+	vector<uint32_t> local(vertCount, 0xFFFFFFFF);
+	Shape shape;
+	
+	// Looks for an offset per axis that takes every vertex of a onto b's, trying the difference at the first vertex and
+	// at the one furthest out, where the rounding is coarsest.
+	auto match = [&](const Shape& a, const Shape& b, Vertex& offset) -> bool {
+		for (int axis = 0; axis < 3; axis++) {
+			bool found = false;
+			for (uint32_t i : { (uint32_t)0, b.far[axis] }) {
+				float d = mesh->v[b.verts[i]]->c[axis] - mesh->v[a.verts[i]]->c[axis];
+				bool ok = true;
+				for (uint32_t k = 0; k < a.verts.size() && ok; k++) {
+					float moved = mesh->v[a.verts[k]]->c[axis] + d;
+					ok = !memcmp(&moved, &mesh->v[b.verts[k]]->c[axis], 4);
+				}
+				if (ok) {
+					offset.c[axis] = d;
+					found = true;
+					break;
+				}
+			}
+			if (!found) return false;
+		}
+		return true;
+	};
+	
+	for (uint32_t p = 0; p < parts.size(); p++) {
+		if (!usable[p]) continue;
+		shape.part = p;
+		shape.verts.clear();
+		shape.corners.clear();
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (uint32_t t : parts[p]) {
+			for (uint32_t v : mesh->t[t]->v) {
+				if (local[v] == 0xFFFFFFFF) {
+					local[v] = shape.verts.size();
+					shape.verts.push_back(v);
+				}
+				shape.corners.push_back(local[v]);
+				hash = (hash ^ local[v]) * 0x100000001b3ull;
+			}
+		}
+		for (uint32_t v : shape.verts) local[v] = 0xFFFFFFFF;
+		for (int axis = 0; axis < 3; axis++) {
+			shape.far[axis] = 0;
+			for (uint32_t i = 1; i < shape.verts.size(); i++) {
+				if (fabs(mesh->v[shape.verts[i]]->c[axis]) > fabs(mesh->v[shape.verts[shape.far[axis]]]->c[axis])) shape.far[axis] = i;
+			}
+		}
+		
+		// Only the latest few of a kind are tried, so lots of different parts with the same layout, like a soup of loose
+		// triangles, don't take forever.
+		auto& bucket = buckets[hash];
+		bool found = false;
+		Vertex offset;
+		for (size_t i = bucket.size(); i-- > 0 && i + 16 >= bucket.size(); ) {
+			Shape& other = shapes[bucket[i]];
+			if (other.corners == shape.corners && match(other, shape, offset)) {
+				other.copies.push_back(p);
+				other.offsets.push_back(offset);
+				found = true;
+				break;
+			}
+		}
+		if (!found) {
+			bucket.push_back(shapes.size());
+			shapes.push_back(move(shape));
+			shape = Shape();
+		}
+	}
+	
+	size_t covered = 0;
+	for (Shape& s : shapes) {
+		if (s.copies.empty()) continue;
+		groups.emplace_back();
+		groups.back().triangles = parts[s.part];
+		groups.back().offsets.swap(s.offsets);
+		s.copies.push_back(s.part);
+		for (uint32_t p : s.copies) {
+			for (uint32_t t : parts[p]) instanced[t] = 1;
+			covered += parts[p].size();
+		}
+	}
+	printf("%u shapes repeated, covering %u of %u triangles.\n", (uint32_t)groups.size(), (uint32_t)covered, (uint32_t)triCount);
+}
+
+
+void pairQuads(Mesh* mesh, vector<Triangle*>& tris, vector<shared_ptr<Quad>>& quads) {
+	printf("Pairing triangles into quads...");
+	fflush(stdout);
+	size_t before = quads.size();
+	
+	// Directed edges to the triangle that has them. A triangle across an edge has it the other way round.
+	unordered_map<uint64_t, uint32_t> edges;
+	edges.reserve(tris.size() * 3);
+	for (uint32_t i = 0; i < tris.size(); i++) {
+		for (int k = 0; k < 3; k++) {
+			uint64_t key = ((uint64_t)tris[i]->v[k] << 32) | tris[i]->v[(k + 1) % 3];
+			edges.emplace(key, i);
+		}
+	}
+	
+	auto sub = [&](uint32_t x, uint32_t y, double* out) {
+		for (int a = 0; a < 3; a++) out[a] = (double)mesh->v[y]->c[a] - mesh->v[x]->c[a];
+	};
+	auto cross = [](const double* u, const double* w, double* out) {
+		out[0] = u[1]*w[2] - u[2]*w[1];
+		out[1] = u[2]*w[0] - u[0]*w[2];
+		out[2] = u[0]*w[1] - u[1]*w[0];
+	};
+	auto dot = [](const double* u, const double* w) {
+		return u[0]*w[0] + u[1]*w[1] + u[2]*w[2];
+	};
+	// Flat to within about a twentieth of a degree, and turning the same way at every corner.
+	auto usable = [&](const uint32_t* q) -> bool {
+		double n[4][3];
+		for (int k = 0; k < 4; k++) {
+			double u[3], w[3];
+			sub(q[k], q[(k + 1) % 4], u);
+			sub(q[(k + 1) % 4], q[(k + 2) % 4], w);
+			cross(u, w, n[k]);
+		}
+		double len[4];
+		for (int k = 0; k < 4; k++) {
+			len[k] = sqrt(dot(n[k], n[k]));
+			if (len[k] == 0) return false;
+		}
+		for (int k = 1; k < 4; k++) {
+			if (dot(n[0], n[k]) < len[0] * len[k] * 0.9999996) return false;
+		}
+		return true;
+	};
+	
+	vector<uint8_t> paired(tris.size(), 0);
+	for (uint32_t i = 0; i < tris.size(); i++) {
+		if (paired[i]) continue;
+		const uint32_t* t = tris[i]->v;
+		for (int k = 0; k < 3; k++) {
+			uint32_t x = t[k], y = t[(k + 1) % 3], m = t[(k + 2) % 3];
+			auto it = edges.find(((uint64_t)y << 32) | x);
+			if (it == edges.end() || it->second == i || paired[it->second]) continue;
+			const uint32_t* o = tris[it->second]->v;
+			uint32_t d = o[0] ^ o[1] ^ o[2] ^ x ^ y;
+			if (d == m || d == x || d == y || m == x || m == y || x == y) continue;
+			// This triangle is y m x, the other y x d.
+			uint32_t q[4] = { y, m, x, d };
+			if (!usable(q)) continue;
+			shared_ptr<Quad> quad = make_shared<Quad>();
+			memcpy(quad->v, q, 16);
+			quads.push_back(quad);
+			paired[i] = paired[it->second] = 1;
+			break;
+		}
+	}
+	
+	size_t kept = 0;
+	for (uint32_t i = 0; i < tris.size(); i++) {
+		if (!paired[i]) tris[kept++] = tris[i];
+	}
+	tris.resize(kept);
+	printf("%u quads, %u triangles left.\n", (uint32_t)(quads.size() - before), (uint32_t)kept);
+}
+
+
+// Forsyth's scoring, for a 32-entry LRU cache: the closer to the front a vertex is the better, except that the three the
+// last triangle used score a little lower, so the order doesn't just keep turning around one vertex. Vertices with few
+// triangles left get a bonus on top, so none of them get stranded.
+#define CACHE_ORDER_SIZE 32
+#define CACHE_ORDER_VALENCE 32
+
+void cacheOrder(const vector<Triangle*>& tris, size_t vertCount, vector<uint32_t>& order) {
+	size_t triCount = tris.size();
+	order.clear();
+	order.reserve(triCount);
+	if (triCount == 0) return;
+	
+	float positionScore[CACHE_ORDER_SIZE];
+	for (int i = 0; i < CACHE_ORDER_SIZE; i++) {
+		positionScore[i] = i < 3 ? 0.75f : powf(1.0f - (float)(i - 3) / (CACHE_ORDER_SIZE - 3), 1.5f);
+	}
+	float valenceScore[CACHE_ORDER_VALENCE];
+	for (int i = 1; i < CACHE_ORDER_VALENCE; i++) valenceScore[i] = 2.0f / sqrtf((float)i);
+	auto score = [&](int position, uint32_t remaining) -> float {
+		if (remaining == 0) return -1.0f;
+		float s = position >= 0 ? positionScore[position] : 0.0f;
+		return s + (remaining < CACHE_ORDER_VALENCE ? valenceScore[remaining] : 2.0f / sqrtf((float)remaining));
+	};
+	
+	// Triangles around each vertex, with the ones still to go at the front of each run.
+	vector<uint32_t> start(vertCount + 1, 0);
+	for (Triangle* t : tris) {
+		for (uint32_t v : t->v) start[v + 1]++;
+	}
+	for (size_t v = 0; v < vertCount; v++) start[v + 1] += start[v];
+	vector<uint32_t> remaining(vertCount);
+	vector<uint32_t> around(start[vertCount]);
+	for (size_t v = 0; v < vertCount; v++) remaining[v] = start[v + 1] - start[v];
+	{
+		vector<uint32_t> fill(start.begin(), start.end() - 1);
+		for (uint32_t i = 0; i < triCount; i++) {
+			for (uint32_t v : tris[i]->v) around[fill[v]++] = i;
+		}
+	}
+	
+	vector<float> vertScore(vertCount);
+	for (size_t v = 0; v < vertCount; v++) vertScore[v] = score(-1, remaining[v]);
+	vector<float> triScore(triCount);
+	for (uint32_t i = 0; i < triCount; i++) {
+		Triangle* t = tris[i];
+		triScore[i] = vertScore[t->a] + vertScore[t->b] + vertScore[t->c];
+	}
+	
+	vector<uint8_t> done(triCount, 0);
+	uint32_t cache[CACHE_ORDER_SIZE + 3], next[CACHE_ORDER_SIZE + 3];
+	int cached = 0;
+	size_t cursor = 0;
+	int64_t best = -1;
+	while (order.size() < triCount) {
+		// Nothing in the cache has triangles left, so carry on from the first one not done yet.
+		if (best < 0) {
+			while (done[cursor]) cursor++;
+			best = cursor;
+		}
+		Triangle* t = tris[best];
+		order.push_back(best);
+		done[best] = 1;
+		for (uint32_t v : t->v) {
+			uint32_t* run = &around[start[v]];
+			for (uint32_t k = 0; k < remaining[v]; k++) {
+				if (run[k] == best) {
+					run[k] = run[--remaining[v]];
+					break;
+				}
+			}
+		}
+		
+		// The triangle's vertices go to the front, then the rest of the cache in order, and whatever's past the end falls out.
+		int count = 0;
+		for (uint32_t v : t->v) {
+			if (find(next, next + count, v) == next + count) next[count++] = v;
+		}
+		for (int i = 0; i < cached; i++) {
+			if (find(next, next + count, cache[i]) == next + count) next[count++] = cache[i];
+		}
+		for (int i = 0; i < count; i++) {
+			uint32_t v = next[i];
+			vertScore[v] = score(i < CACHE_ORDER_SIZE ? i : -1, remaining[v]);
+		}
+		
+		best = -1;
+		float bestScore = -1.0f;
+		for (int i = 0; i < count; i++) {
+			uint32_t v = next[i];
+			for (uint32_t k = 0; k < remaining[v]; k++) {
+				uint32_t j = around[start[v] + k];
+				Triangle* n = tris[j];
+				triScore[j] = vertScore[n->a] + vertScore[n->b] + vertScore[n->c];
+				if (triScore[j] > bestScore) {
+					bestScore = triScore[j];
+					best = j;
+				}
+			}
+		}
+		cached = min(count, CACHE_ORDER_SIZE);
+		memcpy(cache, next, cached * 4);
+	}
+}
+
+void optimizeVertexCache(Mesh* mesh) {
+	printf("Ordering %lu triangles for the vertex cache...", (unsigned long)mesh->t.size());
+	fflush(stdout);
+	vector<Triangle*> tris;
+	tris.reserve(mesh->t.size());
+	for (auto& t : mesh->t) tris.push_back(t.get());
+	vector<uint32_t> order;
+	cacheOrder(tris, mesh->v.size(), order);
+	
+	vector<shared_ptr<Triangle>> sorted;
+	sorted.reserve(order.size());
+	for (uint32_t i : order) sorted.push_back(mesh->t[i]);
+	mesh->t.swap(sorted);
+	printf("Done.\n");
+}
+
+void measureVertexCache(Mesh* mesh, unsigned int size, double& acmr, double& atvr) {
+	// FIFO, as GPUs have it: a vertex is in the cache if fewer than (size) misses have happened since it went in.
+	vector<uint64_t> stamp(mesh->v.size(), 0);
+	uint64_t misses = 0, used = 0;
+	size_t triCount = 0;
+	auto visit = [&](uint32_t v) {
+		if (stamp[v] == 0) used++;
+		if (stamp[v] == 0 || misses - stamp[v] >= size) {
+			misses++;
+			stamp[v] = misses;
+		}
+	};
+	for (auto& t : mesh->t) {
+		for (uint32_t v : t->v) visit(v);
+		triCount++;
+	}
+	for (auto& q : mesh->q) {
+		for (uint32_t v : { q->a, q->b, q->c, q->a, q->c, q->d }) visit(v);
+		triCount += 2;
+	}
+	acmr = triCount ? (double)misses / triCount : 0.0;
+	atvr = used ? (double)misses / used : 0.0;
+}
+
+// Mixes the bits of a vertex's coordinates, the doubles too for a precise mesh, down to 32 bits.
+static uint32_t vertexHash(const Vertex* v, bool precise) {
+	uint64_t h = 0;
+	if (precise) {
+		const PreciseVertex* p = static_cast<const PreciseVertex*>(v);
+		for (int axis = 0; axis < 3; axis++) {
+			uint64_t bits;
+			memcpy(&bits, &p->d[axis], 8);
+			h = (h ^ bits) * 0x9E3779B97F4A7C15ull;
+			h ^= h >> 29;
+		}
+	} else {
+		for (int axis = 0; axis < 3; axis++) {
+			uint32_t bits;
+			memcpy(&bits, &v->c[axis], 4);
+			h = (h ^ bits) * 0x9E3779B97F4A7C15ull;
+			h ^= h >> 29;
+		}
+	}
+	return h >> 32;
+}
+static bool sameVertex(const Vertex* a, const Vertex* b, bool precise) {
+	if (precise) return !memcmp(static_cast<const PreciseVertex*>(a)->d, static_cast<const PreciseVertex*>(b)->d, 24);
+	return !memcmp(a->c, b->c, 12);
+}
+
+void compactVertices(Mesh* mesh, unsigned int threads) {
+	size_t vertCount = mesh->v.size();
+	if (threads < 1) threads = 1;
+	
+	printf("Compacting %lu vertices...", (unsigned long)vertCount);
+	fflush(stdout);
+	
+	vector<uint8_t> used(vertCount, 0);
+	for (auto& t : mesh->t) {
+		for (uint32_t i : t->v) {
+			if (i >= vertCount) {
+				fprintf(stderr, "Error: A triangle uses vertex %u, but there are only %lu.\n", i, (unsigned long)vertCount);
+				exit(__LINE__);
+			}
+			used[i] = 1;
+		}
+	}
+	for (auto& q : mesh->q) {
+		for (uint32_t i : q->v) {
+			if (i >= vertCount) {
+				fprintf(stderr, "Error: A quad uses vertex %u, but there are only %lu.\n", i, (unsigned long)vertCount);
+				exit(__LINE__);
+			}
+			used[i] = 1;
+		}
+	}
+	
+	vector<uint32_t> values;
+	values.reserve(vertCount);
+	for (size_t i = 0; i < vertCount; i++) {
+		if (used[i]) values.push_back(i);
+	}
+	size_t usedCount = values.size();
+	
+	// Hash the coordinates and radix sort by hash, so exact duplicates end up next to each other. The sort is stable, so
+	// the first of each set is the one with the lowest index, and it keeps its place.
+	vector<uint64_t> keys(usedCount);
+	vector<thread> workers;
+	for (unsigned int t = 0; t < threads; t++) {
+		workers.emplace_back([&, t]() {
+			for (size_t i = usedCount * t / threads; i < usedCount * (t+1) / threads; i++) {
+				keys[i] = vertexHash(mesh->v[values[i]].get(), mesh->precise);
+			}
+		});
+	}
+	for (auto& worker : workers) worker.join();
+	workers.clear();
+	radixSort(keys, values, 32, threads);
+	
+	// Point each duplicate at its first copy. Runs of the same hash are nearly always one vertex, so checking every
+	// first copy in the run is cheap.
+	vector<uint32_t> first(vertCount, 0xFFFFFFFF);
+	size_t duplicates = 0;
+	for (size_t begin = 0, end; begin < usedCount; begin = end) {
+		for (end = begin + 1; end < usedCount && keys[end] == keys[begin]; end++);
+		for (size_t i = begin; i < end; i++) {
+			uint32_t v = values[i];
+			first[v] = v;
+			for (size_t j = begin; j < i; j++) {
+				uint32_t w = values[j];
+				if (first[w] == w && sameVertex(mesh->v[w].get(), mesh->v[v].get(), mesh->precise)) {
+					first[v] = w;
+					duplicates++;
+					break;
+				}
+			}
+		}
+	}
+	keys.clear();
+	values.clear();
+	
+	if (usedCount == vertCount && duplicates == 0) {
+		printf("Nothing to remove.\n");
+		return;
+	}
+	
+	// Number the vertices that are left in their old order, so whatever order the mesh was in survives.
+	vector<uint32_t> remap(vertCount, 0xFFFFFFFF);
+	vector<shared_ptr<Vertex>> verts;
+	verts.reserve(usedCount - duplicates);
+	for (size_t i = 0; i < vertCount; i++) {
+		if (first[i] == i) {
+			remap[i] = verts.size();
+			verts.push_back(mesh->v[i]);
+		} else if (first[i] != 0xFFFFFFFF) {
+			remap[i] = remap[first[i]];
+		}
+	}
+	mesh->v.swap(verts);
+	verts.clear();
+	
+	size_t triCount = mesh->t.size();
+	size_t quadCount = mesh->q.size();
+	for (unsigned int t = 0; t < threads; t++) {
+		workers.emplace_back([&, t]() {
+			for (size_t i = triCount * t / threads; i < triCount * (t+1) / threads; i++) {
+				for (uint32_t& v : mesh->t[i]->v) v = remap[v];
+			}
+			for (size_t i = quadCount * t / threads; i < quadCount * (t+1) / threads; i++) {
+				for (uint32_t& v : mesh->q[i]->v) v = remap[v];
+			}
+		});
+	}
+	for (auto& worker : workers) worker.join();
+	mesh->updateBounds();
+	
+	printf("Done, %lu unused and %lu duplicates removed.\n", (unsigned long)(vertCount - usedCount), (unsigned long)duplicates);
+}
+
+void weldVertices(Mesh* mesh, float epsilon) {
+	size_t vertCount = mesh->v.size();
+	printf("Welding vertices within %g...", epsilon);
+	fflush(stdout);
+	
+	// Cells are four times epsilon across, so anything close enough is in the same cell, or on each axis the next one
+	// over if the vertex is within epsilon of that side: usually just 1 or 2 cells to look in rather than 27. Cells are
+	// only looked up by a hash of their coordinates, and the distance check sorts out any that collide.
+	auto cellKey = [](int64_t x, int64_t y, int64_t z) {
+		uint64_t h = (uint64_t)x * 0x9E3779B97F4A7C15ull;
+		h = (h ^ (uint64_t)y) * 0xC2B2AE3D27D4EB4Full;
+		h = (h ^ (uint64_t)z) * 0x165667B19E3779F9ull;
+		return h ^ (h >> 29);
+	};
+	
+	// Open addressing, at most half full: each slot has a cell's key and its most recently kept vertex, and next chains
+	// back through the rest kept in that cell. Keys only need to be good enough to keep cells apart most of the time.
+	size_t slots = 2;
+	while (slots < vertCount * 2) slots <<= 1;
+	vector<uint32_t> keys(slots);
+	vector<uint32_t> heads(slots, 0xFFFFFFFF);
+	auto slotOf = [&](uint64_t hash) {
+		size_t pos = hash & (slots - 1);
+		while (heads[pos] != 0xFFFFFFFF && keys[pos] != (uint32_t)(hash >> 32)) pos = (pos + 1) & (slots - 1);
+		return pos;
+	};
+	vector<uint32_t> next(vertCount, 0xFFFFFFFF);
+	
+	// A flat copy of the coordinates, so walking a cell doesn't chase a pointer per vertex.
+	vector<float> xyz(vertCount * 3);
+	for (size_t i = 0; i < vertCount; i++) {
+		memcpy(&xyz[i*3], mesh->v[i]->c, 12);
+	}
+	
+	// The first vertex to land somewhere stays put, and later ones within epsilon of it on every axis are moved onto it.
+	// Welding only ever to those keeps chains of close vertices from creeping further than epsilon.
+	vector<uint32_t> target(vertCount);
+	size_t welded = 0;
+	for (size_t i = 0; i < vertCount; i++) {
+		const float* v = &xyz[i*3];
+		int64_t cell[3];
+		int side[3];
+		for (int axis = 0; axis < 3; axis++) {
+			double f = v[axis] / (4.0 * epsilon);
+			cell[axis] = (int64_t)floor(f);
+			f -= cell[axis];
+			side[axis] = f <= 0.25 ? -1 : f >= 0.75 ? 1 : 0;
+		}
+		
+		// Own cell first, since that's where a match nearly always is.
+		target[i] = i;
+		for (int n = 0; n < 8 && target[i] == i; n++) {
+			if (((n & 1) && !side[0]) || ((n & 2) && !side[1]) || ((n & 4) && !side[2])) continue;
+			size_t pos = slotOf(cellKey(cell[0] + (n & 1 ? side[0] : 0), cell[1] + (n & 2 ? side[1] : 0),
+				cell[2] + (n & 4 ? side[2] : 0)));
+			for (uint32_t j = heads[pos]; j != 0xFFFFFFFF; j = next[j]) {
+				const float* w = &xyz[j*3];
+				if (fabs(v[0] - w[0]) <= epsilon && fabs(v[1] - w[1]) <= epsilon && fabs(v[2] - w[2]) <= epsilon) {
+					target[i] = j;
+					break;
+				}
+			}
+		}
+		
+		if (target[i] != i) {
+			welded++;
+			continue;
+		}
+		uint64_t hash = cellKey(cell[0], cell[1], cell[2]);
+		size_t pos = slotOf(hash);
+		keys[pos] = hash >> 32;
+		next[i] = heads[pos];
+		heads[pos] = i;
+	}
+	xyz.clear();
+	keys.clear();
+	heads.clear();
+	next.clear();
+	
+	// Triangles that had two corners welded together are gone, and so are quads left with fewer than three. Faces that
+	// were degenerate already are left as they were, since the weld didn't do that to them.
+	auto distinct = [](const uint32_t* v, uint32_t* corners) {
+		int n = 0;
+		for (int k = 0; k < 4; k++) {
+			if (n == 0 || v[k] != corners[n-1]) corners[n++] = v[k];
+		}
+		if (n > 1 && corners[n-1] == corners[0]) n--;
+		return n;
+	};
+	size_t degenerate = 0;
+	vector<shared_ptr<Triangle>> tris;
+	tris.reserve(mesh->t.size());
+	for (auto& t : mesh->t) {
+		bool before = t->a == t->b || t->b == t->c || t->c == t->a;
+		for (uint32_t& i : t->v) i = target[i];
+		if (!before && (t->a == t->b || t->b == t->c || t->c == t->a)) degenerate++;
+		else tris.push_back(t);
+	}
+	vector<shared_ptr<Quad>> quads;
+	quads.reserve(mesh->q.size());
+	for (auto& q : mesh->q) {
+		uint32_t corners[4];
+		int before = distinct(q->v, corners);
+		for (uint32_t& i : q->v) i = target[i];
+		int n = distinct(q->v, corners);
+		
+		if (n == before) {
+			quads.push_back(q);
+		} else if (n == 3) {
+			tris.push_back(make_shared<Triangle>(corners));
+		} else {
+			degenerate++;
+		}
+	}
+	mesh->t.swap(tris);
+	mesh->q.swap(quads);
+	
+	printf("Done, %lu welded, %lu faces collapsed.\n", (unsigned long)welded, (unsigned long)degenerate);
+}
\ No newline at end of file
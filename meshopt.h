@@ -0,0 +1,57 @@
+#ifndef MESHOPT_H
+#define MESHOPT_H
+
+#include "config.h"
+#include <vector>
+#include "mesh.h"
+
+// Rewrites all vertex indices so that order[i] becomes vertex i. Vertices not in order are dropped.
+void permuteVertices(Mesh* mesh, const std::vector<uint32_t>& order);
+
+// Sorts triangles along a space-filling curve through their centroids, Morton or Hilbert.
+void reorderTriangles(Mesh* mesh, bool hilbert, unsigned int threads);
+// Renumbers vertices in the order triangles first use them, so the vertex list follows the triangle list.
+void renumberVertices(Mesh* mesh);
+// Drops vertices nothing uses and merges ones that are bit for bit the same (the doubles, too, on a precise mesh),
+// then points the triangles and quads at what's left. The vertices keep their order. Linear time, on (threads) threads.
+void compactVertices(Mesh* mesh, unsigned int threads);
+// Moves every vertex within epsilon on each axis of one kept earlier onto it, using a hash of epsilon-sized cells, then
+// drops the faces that collapse. Faces that were degenerate already are kept. Expected linear time. Leaves the moved vertices unused, for compactVertices().
+void weldVertices(Mesh* mesh, float epsilon);
+
+// Orders triangles so each reuses as many as it can of the vertices a GPU has just transformed (Forsyth 2006). Fills order
+// with the new position of each of tris in turn: order[i] is the index in tris of the i'th triangle to draw.
+void cacheOrder(const std::vector<Triangle*>& tris, size_t vertCount, std::vector<uint32_t>& order);
+// Sorts the mesh's triangles by cacheOrder.
+void optimizeVertexCache(Mesh* mesh);
+// Simulates a FIFO post-transform cache of (size) vertices over the triangles in order, then the quads as two triangles
+// each. acmr gets the vertices transformed per triangle (3 at worst, around 0.5 at best on big meshes), and atvr the same
+// per vertex used (1 at best).
+void measureVertexCache(Mesh* mesh, unsigned int size, double& acmr, double& atvr);
+
+// One half-edge collapse, as done by decimate(): vertex u moved onto v, taking the triangles that had both with it.
+struct EdgeCollapse {
+	uint32_t u, v;
+	std::vector<uint32_t> changed;	// Triangles that had u, and now have v in its place.
+	std::vector<uint32_t> removed;	// Triangles that had both.
+};
+// Collapses the shortest edges first until (target) triangles are left, or no more can go without folding the surface
+// over or pinching it. The mesh is left alone; tris gets every triangle's corners as they ended up, or as they were when
+// it was removed, and alive says which ones are left. Vertices used by quads stay put.
+void decimate(Mesh* mesh, size_t target, std::vector<Triangle>& tris, std::vector<uint8_t>& alive, std::vector<EdgeCollapse>& collapses);
+
+// A shape that turns up more than once in the mesh: the triangles of its first copy, and how far each other copy is moved.
+struct InstanceGroup {
+	std::vector<uint32_t> triangles;	// The first copy's triangles, in mesh order.
+	std::vector<Vertex> offsets;		// Of each other copy from the first.
+};
+// Finds connected parts of the mesh that are translated copies of each other, exactly enough that adding the offset to
+// every coordinate of the first copy as a float gives the other one bit for bit. instanced says which triangles are in a
+// group, first copies included. Parts that share vertices with quads are left out.
+void findInstances(Mesh* mesh, std::vector<InstanceGroup>& groups, std::vector<uint8_t>& instanced);
+
+// Pairs up triangles that share an edge and together make a flat, convex quad, which splits back into the same two
+// triangles as a b c and a c d. The pairs go into quads, and tris is left with the ones that couldn't be paired, in order.
+void pairQuads(Mesh* mesh, std::vector<Triangle*>& tris, std::vector<std::shared_ptr<Quad>>& quads);
+
+#endif
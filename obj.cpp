@@ -7,8 +7,9 @@
 #include "obj.h"
 using namespace std;
 
-Mesh* readOBJ(std::filesystem::path file) {
+Mesh* readOBJ(std::filesystem::path file, bool precise) {
 	Mesh* mesh = new Mesh();
+	mesh->precise = precise;
 	
 	#ifdef _WIN32
 		printf("Reading from %ls...", file.c_str());
@@ -45,18 +46,19 @@ Mesh* readOBJ(std::filesystem::path file) {
 			char* x = strtok(NULL, " \r\n");
 			char* y = strtok(NULL, " \r\n");
 			char* z = strtok(NULL, " \r\n");
-			mesh->add(make_shared<Vertex>(atof(x), atof(y), atof(z)));
+			if (precise) mesh->add(make_shared<PreciseVertex>(atof(x), atof(y), atof(z)));
+			else mesh->add(make_shared<Vertex>(atof(x), atof(y), atof(z)));
 		} else if (!strcmp(type, "f")) {
-			vector<int> vertices;
+			vector<uint32_t> vertices;
 			char* c;
 			while ((c = strtok(NULL, " \r\n"))) {
-				int i = atoi(c);
-				if (i == 0) {
+				long long i = atoll(c);
+				if (i < 0) i += mesh->v.size();
+				else i--;
+				if (i < 0 || (unsigned long long)i >= SML_MAX_VERTICES) {
 					fprintf(stderr, "Unsupported OBJ file: Invalid vertex index '%s'\n", c);
 					exit(__LINE__);
 				}
-				if (i < 0) i += mesh->v.size();
-				else i--;
 				vertices.push_back(i);
 			}
 
@@ -108,12 +110,13 @@ void writeOBJ(filesystem::path file, Mesh* mesh) {
 		fprintf(fp, "v %f %f %f\n", v->x, v->y, v->z);
 	}
 	
+	// OBJ counts from 1, which takes index 0xFFFFFFFF past 32 bits.
 	for (auto& t : mesh->t) {
-		fprintf(fp, "f %u %u %u\n", t->a+1, t->b+1, t->c+1);
+		fprintf(fp, "f %llu %llu %llu\n", t->a+1ull, t->b+1ull, t->c+1ull);
 	}
 	
 	for (auto& q : mesh->q) {
-		fprintf(fp, "f %u %u %u %u\n", q->a+1, q->b+1, q->c+1, q->d+1);
+		fprintf(fp, "f %llu %llu %llu %llu\n", q->a+1ull, q->b+1ull, q->c+1ull, q->d+1ull);
 	}
 	
 	fclose(fp);
@@ -3,7 +3,8 @@
 
 #include "config.h"
 
-Mesh* readOBJ(std::filesystem::path file);
+// With precise, vertices keep the full double precision of the file as PreciseVertex.
+Mesh* readOBJ(std::filesystem::path file, bool precise = false);
 void writeOBJ(std::filesystem::path file, Mesh* mesh);
 
 #endif
\ No newline at end of file
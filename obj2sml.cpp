@@ -10,65 +10,41 @@
 #include "mesh.h"
 #include "obj.h"
 #include "sml.h"
+#include "meshopt.h"
+#include "cliopts.h"
 
 using namespace std;
 
-#ifndef _MSC_VER
-#include <getopt.h>
-
-static const struct option longopts[] = {
-	{"comment",		required_argument,	0,	'c'},
-	{"strip",		optional_argument,	0,	's'},
-	{"rm",			no_argument,		0,   1 },
-	{"help",		no_argument,		0,	'h'},
-	{0, 0, 0, 0}
-};
-#endif
-
 int main(int argc, char* argv[]) {
-	uint32_t writeflags = 0;
-	vector<string> comments;
+	WriteArgs args(SMLFlags::STRIP_MAP);
 	bool rm = 0;
 	
 	#ifdef _MSC_VER
 	int optind = 1;
 	#else
+	vector<struct option> longopts;
+	addWriteOptions(longopts, true);
+	longopts.push_back({"rm",		no_argument,		0,   1 });
+	longopts.push_back({"help",		no_argument,		0,	'h'});
+	longopts.push_back({0, 0, 0, 0});
+	
 	while (1) {
 		int option_index = 0;
-		int c = getopt_long(argc, argv, "c:s::h", longopts, &option_index);
+		int c = getopt_long(argc, argv, WRITE_SHORTOPTS "h", longopts.data(), &option_index);
 		if (c == -1) break;
+		if (parseWriteOption(c, optarg, args)) continue;
 		
 		switch (c) {
-			case 'c': {
-				comments.emplace_back(optarg);
-			} break;
-			
-			case 's': {
-				if (optarg && optarg[0]) {
-					if (!strcasecmp(optarg, "map")) writeflags = SMLFlags::STRIP_MAP;
-					if (!strcasecmp(optarg, "next")) writeflags = SMLFlags::STRIP_NEXT;
-					if (!strcasecmp(optarg, "all")) writeflags = SMLFlags::STRIP_EXHAUSTIVE;
-				} else {
-					writeflags = SMLFlags::STRIP_MAP;
-				}
-			} break;
-			
 			case 1:
 				rm = 1;
 				break;
 			
 			case 'h':
-				printf("Usage: %s [options] <file.stl>...\n"
-					"Options:\n"
-					"-c=<...> --comment=<...>     Add the specified text to the resulting SML file as a comment.\n"
-					"                             Can be used more than once for multiple comments.\n"
-					"-s[=mode] --strip[=mode]     Attempt to find triangle strips in the model.\n"
-					"                             Mode can be one of: map (default), next, all\n"
-					"                               map: The default, uses a spatial map to check nearby triangles.\n"
-					"                               next: Checks the next 1000 triangles in the source file.\n"
-					"                               all: Does an exhaustive scan of all triangles. Very slow.\n"
-					"--rm                         Remove original file after converting.\n"
-					, argv[0]);
+				printf("Usage: %s [options] <file.obj>...\n"
+					"Options:\n", argv[0]);
+				printWriteHelp(args, "Store vertices as doubles, keeping all the precision of the OBJ file's coordinates.\n"
+					"                             Takes the place of --grid, --quantize and --predict.\n");
+				printf("--rm                         Remove original file after converting.\n");
 				return 1;
 		}
 	}
@@ -76,12 +52,14 @@ int main(int argc, char* argv[]) {
 	
 	for (int i = optind; i < argc; i++) {
 		filesystem::path file(argv[i]);
-		Mesh* mesh = readOBJ(file);
+		Mesh* mesh = readOBJ(file, args.flags & SMLFlags::DOUBLE_VERTICES);
+		if (args.weld > 0) weldVertices(mesh, args.weld);
+		compactVertices(mesh, args.options.threads);
 		
 		file.replace_extension(".sml");
-		mesh->comments = comments;
+		mesh->comments = args.comments;
 		
-		writeSML(file, mesh, writeflags);
+		writeSML(file, mesh, args.flags, args.options);
 		
 		delete mesh;
 		if (rm) filesystem::remove(argv[i]);
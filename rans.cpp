@@ -0,0 +1,229 @@
+// Byte-wise rANS entropy coder, after Fabian Giesen's rans_byte.h (public domain).
+// Each byte plane gets its own static frequency table, and four interleaved states share one byte stream.
+#include <string.h>
+#include <assert.h>
+
+#include "rans.h"
+using namespace std;
+
+#define RANS_SCALE_BITS 12
+#define RANS_SCALE (1u << RANS_SCALE_BITS)
+#define RANS_L (1u << 23)
+
+enum PlaneMode {
+	PLANE_RAW = 0,
+	PLANE_RANS = 1
+};
+
+struct RansTable {
+	uint32_t freq[256];
+	uint32_t cum[256];
+};
+
+// Scales the byte counts so they add up to RANS_SCALE, keeping every symbol that occurs at 1 or more.
+static void normalize(const size_t* counts, size_t total, RansTable& table) {
+	uint32_t sum = 0;
+	int largest = 0;
+	for (int s = 0; s < 256; s++) {
+		uint32_t f = 0;
+		if (counts[s]) {
+			f = (uint32_t)((uint64_t)counts[s] * RANS_SCALE / total);
+			if (f == 0) f = 1;
+		}
+		table.freq[s] = f;
+		sum += f;
+		if (f > table.freq[largest]) largest = s;
+	}
+	
+	if ((int64_t)table.freq[largest] + RANS_SCALE - sum >= 1) {
+		table.freq[largest] += RANS_SCALE - sum;
+	} else {
+		// Lots of rare symbols rounded up to 1; take it back from whichever symbols can spare it.
+		while (sum > RANS_SCALE) {
+			int best = -1;
+			for (int s = 0; s < 256; s++) {
+				if (table.freq[s] > 1 && (best < 0 || table.freq[s] > table.freq[best])) best = s;
+			}
+			table.freq[best]--;
+			sum--;
+		}
+	}
+	
+	uint32_t cum = 0;
+	for (int s = 0; s < 256; s++) {
+		table.cum[s] = cum;
+		cum += table.freq[s];
+	}
+	assert(cum == RANS_SCALE);
+}
+
+static inline void encodePut(uint32_t& x, uint8_t*& ptr, uint32_t start, uint32_t freq) {
+	uint32_t xMax = ((RANS_L >> RANS_SCALE_BITS) << 8) * freq;
+	while (x >= xMax) {
+		*--ptr = x & 0xFF;
+		x >>= 8;
+	}
+	x = ((x / freq) << RANS_SCALE_BITS) + (x % freq) + start;
+}
+
+static inline void encodeFlush(uint32_t x, uint8_t*& ptr) {
+	ptr -= 4;
+	memcpy(ptr, &x, 4);
+}
+
+// Codes one plane (every stride-th byte from src), appending it to out. Falls back to storing it raw if that's smaller.
+static void compressPlane(const uint8_t* src, size_t n, unsigned int stride, vector<uint8_t>& out) {
+	size_t counts[256] = { 0 };
+	for (size_t i = 0; i < n; i++) {
+		counts[src[i * stride]]++;
+	}
+	
+	RansTable table;
+	normalize(counts, n, table);
+	
+	// rANS output is built backwards, from the end of the buffer. Past about 1.1n it's lost anyway, so stop there.
+	vector<uint8_t> buffer(n + n/8 + 64);
+	uint8_t* end = buffer.data() + buffer.size();
+	uint8_t* ptr = end;
+	uint8_t* limit = buffer.data() + 16;
+	uint32_t x[4] = { RANS_L, RANS_L, RANS_L, RANS_L };
+	bool overflow = false;
+	for (size_t i = n; i-- > 0;) {
+		uint8_t s = src[i * stride];
+		encodePut(x[i & 3], ptr, table.cum[s], table.freq[s]);
+		if (ptr < limit) {
+			overflow = true;
+			break;
+		}
+	}
+	
+	size_t tableSize = 32 + 2 * 256;
+	if (!overflow) {
+		for (int state = 3; state >= 0; state--) {
+			encodeFlush(x[state], ptr);
+		}
+		tableSize = 32;
+		for (int s = 0; s < 256; s++) {
+			if (table.freq[s]) tableSize += 2;
+		}
+	}
+	
+	size_t coded = end - ptr;
+	if (overflow || 1 + tableSize + 4 + coded >= 1 + n) {
+		out.push_back(PLANE_RAW);
+		for (size_t i = 0; i < n; i++) {
+			out.push_back(src[i * stride]);
+		}
+		return;
+	}
+	
+	out.push_back(PLANE_RANS);
+	uint8_t present[32] = { 0 };
+	for (int s = 0; s < 256; s++) {
+		if (table.freq[s]) present[s >> 3] |= 1 << (s & 7);
+	}
+	out.insert(out.end(), present, present + 32);
+	for (int s = 0; s < 256; s++) {
+		if (!table.freq[s]) continue;
+		uint16_t f = table.freq[s];
+		out.insert(out.end(), (uint8_t*)&f, (uint8_t*)&f + 2);
+	}
+	uint32_t coded32 = coded;
+	out.insert(out.end(), (uint8_t*)&coded32, (uint8_t*)&coded32 + 4);
+	out.insert(out.end(), ptr, end);
+}
+
+void ransCompress(const uint8_t* src, size_t len, unsigned int stride, vector<uint8_t>& out) {
+	assert(stride >= 1);
+	for (unsigned int plane = 0; plane < stride; plane++) {
+		size_t n = len > plane ? (len - plane + stride - 1) / stride : 0;
+		compressPlane(src + plane, n, stride, out);
+	}
+}
+
+
+#define RANS_DECODE(state) { \
+	uint32_t m = state & (RANS_SCALE - 1); \
+	uint8_t s = symbols[m]; \
+	state = table.freq[s] * (state >> RANS_SCALE_BITS) + m - table.cum[s]; \
+	while (state < RANS_L && ptr < end) state = (state << 8) | *ptr++; \
+	*out = s; \
+	out += stride; \
+}
+
+static const uint8_t* decompressPlane(const uint8_t* src, const uint8_t* srcEnd, uint8_t* out, size_t n, unsigned int stride) {
+	if (src >= srcEnd) return NULL;
+	uint8_t mode = *src++;
+	
+	if (mode == PLANE_RAW) {
+		if ((size_t)(srcEnd - src) < n) return NULL;
+		for (size_t i = 0; i < n; i++) {
+			out[i * stride] = src[i];
+		}
+		return src + n;
+	}
+	if (mode != PLANE_RANS || srcEnd - src < 32) return NULL;
+	
+	RansTable table;
+	const uint8_t* present = src;
+	src += 32;
+	uint32_t cum = 0;
+	for (int s = 0; s < 256; s++) {
+		table.cum[s] = cum;
+		table.freq[s] = 0;
+		if (present[s >> 3] & (1 << (s & 7))) {
+			if (srcEnd - src < 2) return NULL;
+			uint16_t f;
+			memcpy(&f, src, 2);
+			src += 2;
+			table.freq[s] = f;
+			cum += f;
+		}
+	}
+	if (cum != RANS_SCALE) return NULL;
+	
+	uint8_t symbols[RANS_SCALE];
+	for (int s = 0; s < 256; s++) {
+		memset(symbols + table.cum[s], s, table.freq[s]);
+	}
+	
+	uint32_t coded;
+	if (srcEnd - src < 4) return NULL;
+	memcpy(&coded, src, 4);
+	src += 4;
+	if ((size_t)(srcEnd - src) < coded || coded < 16) return NULL;
+	const uint8_t* ptr = src;
+	const uint8_t* end = src + coded;
+	
+	uint32_t x0, x1, x2, x3;
+	memcpy(&x0, ptr, 4);
+	memcpy(&x1, ptr + 4, 4);
+	memcpy(&x2, ptr + 8, 4);
+	memcpy(&x3, ptr + 12, 4);
+	ptr += 16;
+	
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		RANS_DECODE(x0);
+		RANS_DECODE(x1);
+		RANS_DECODE(x2);
+		RANS_DECODE(x3);
+	}
+	if (i < n) RANS_DECODE(x0);
+	if (i + 1 < n) RANS_DECODE(x1);
+	if (i + 2 < n) RANS_DECODE(x2);
+	
+	// A good stream ends exactly where it started, with every state back at RANS_L.
+	if (ptr != end || x0 != RANS_L || x1 != RANS_L || x2 != RANS_L || x3 != RANS_L) return NULL;
+	return end;
+}
+
+bool ransDecompress(const uint8_t* src, size_t srcLen, uint8_t* dst, size_t len, unsigned int stride) {
+	const uint8_t* srcEnd = src + srcLen;
+	for (unsigned int plane = 0; plane < stride; plane++) {
+		size_t n = len > plane ? (len - plane + stride - 1) / stride : 0;
+		src = decompressPlane(src, srcEnd, dst + plane, n, stride);
+		if (!src) return false;
+	}
+	return src == srcEnd;
+}
@@ -0,0 +1,14 @@
+#ifndef RANS_H
+#define RANS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Compresses len bytes into a self-contained block, appended to out.
+// The input is split into (stride) byte planes first, so bytes at the same position in each element are coded together.
+void ransCompress(const uint8_t* src, size_t len, unsigned int stride, std::vector<uint8_t>& out);
+// Decompresses a block from ransCompress into exactly len bytes. Returns false if the block is malformed.
+bool ransDecompress(const uint8_t* src, size_t srcLen, uint8_t* dst, size_t len, unsigned int stride);
+
+#endif
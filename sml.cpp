@@ -2,161 +2,2521 @@
 #include <stdio.h>
 #include <time.h>
 #include <assert.h>
+#include <math.h>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#define SML_SSE2
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SML_TARGET_SSSE3
+#else
+#define SML_TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+#endif
 
 #include "mesh.h"
 #include "sml.h"
+#include "meshopt.h"
+#include "rans.h"
+#include "edgebreaker.h"
 using namespace std;
 
+// File offsets can pass 2 GB, which doesn't fit in the long that ftell and fseek use on Windows.
+static inline uint64_t ftell64(FILE* fp) {
+	#ifdef _WIN32
+	return _ftelli64(fp);
+	#else
+	return ftello(fp);
+	#endif
+}
+static inline int fseek64(FILE* fp, int64_t offset, int whence) {
+	#ifdef _WIN32
+	return _fseeki64(fp, offset, whence);
+	#else
+	return fseeko(fp, offset, whence);
+	#endif
+}
+
+// One axis of a grid vertex list (type 7): value = (float)(origin + k * scale), computed in double precision.
+// 32 bits means the axis didn't fit a grid and holds plain floats.
+struct GridAxis {
+	uint8_t bits;
+	double origin;
+	double scale;
+};
+
+// Makes room for n more items, at least doubling the space, so a list read in many segments isn't copied for each one.
+template<class T>
+static inline void reserveMore(vector<T>& items, size_t n) {
+	if (items.size() + n > items.capacity()) items.reserve(max(items.size() + n, items.capacity() * 2));
+}
+
+// Widens count packed little-endian integers of the given size to uint32.
+static void unpackGridInts(const uint8_t* in, uint8_t bits, size_t count, uint32_t* out) {
+	size_t i = 0;
+	#ifdef SML_SSE2
+	__m128i zero = _mm_setzero_si128();
+	if (bits == 8) {
+		for (; i + 16 <= count; i += 16) {
+			__m128i b = _mm_loadu_si128((const __m128i*)(in + i));
+			__m128i lo = _mm_unpacklo_epi8(b, zero);
+			__m128i hi = _mm_unpackhi_epi8(b, zero);
+			_mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi16(lo, zero));
+			_mm_storeu_si128((__m128i*)(out + i + 4), _mm_unpackhi_epi16(lo, zero));
+			_mm_storeu_si128((__m128i*)(out + i + 8), _mm_unpacklo_epi16(hi, zero));
+			_mm_storeu_si128((__m128i*)(out + i + 12), _mm_unpackhi_epi16(hi, zero));
+		}
+	} else if (bits == 16) {
+		for (; i + 8 <= count; i += 8) {
+			__m128i w = _mm_loadu_si128((const __m128i*)(in + i*2));
+			_mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi16(w, zero));
+			_mm_storeu_si128((__m128i*)(out + i + 4), _mm_unpackhi_epi16(w, zero));
+		}
+	}
+	#endif
+	size_t bytes = bits / 8;
+	for (; i < count; i++) {
+		const uint8_t* p = in + i*bytes;
+		uint32_t k = p[0];
+		if (bytes > 1) k |= (uint32_t)p[1] << 8;
+		if (bytes > 2) k |= (uint32_t)p[2] << 16;
+		out[i] = k;
+	}
+}
+
+// Decodes one axis of a grid vertex list into every third float of out.
+static void decodeGridAxis(const uint8_t* in, const GridAxis& axis, size_t count, float* out) {
+	if (axis.bits == 32) {
+		for (size_t i = 0; i < count; i++) {
+			memcpy(&out[i*3], in + i*4, 4);
+		}
+		return;
+	}
+	
+	vector<uint32_t> ints(count);
+	unpackGridInts(in, axis.bits, count, ints.data());
+	
+	size_t i = 0;
+	#ifdef SML_SSE2
+	// Separate multiply and add, rounded the same way as the scalar loop below and the writer's check.
+	__m128d origin = _mm_set1_pd(axis.origin);
+	__m128d scale = _mm_set1_pd(axis.scale);
+	alignas(16) float f[4];
+	for (; i + 4 <= count; i += 4) {
+		__m128i k = _mm_loadu_si128((const __m128i*)&ints[i]);
+		__m128d lo = _mm_add_pd(origin, _mm_mul_pd(_mm_cvtepi32_pd(k), scale));
+		__m128d hi = _mm_add_pd(origin, _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(k, 8)), scale));
+		_mm_store_ps(f, _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi)));
+		out[i*3] = f[0];
+		out[i*3 + 3] = f[1];
+		out[i*3 + 6] = f[2];
+		out[i*3 + 9] = f[3];
+	}
+	#endif
+	for (; i < count; i++) {
+		out[i*3] = (float)(axis.origin + (double)ints[i] * axis.scale);
+	}
+}
+
+static void readGridVertices(Mesh* mesh, const vector<uint8_t>& payload) {
+	assert(payload.size() >= 4 + 3*17);
+	const uint8_t* p = payload.data();
+	uint32_t count;
+	memcpy(&count, p, 4);
+	p += 4;
+	
+	GridAxis axes[3];
+	size_t length = 4 + 3*17;
+	for (int a = 0; a < 3; a++) {
+		axes[a].bits = *p++;
+		memcpy(&axes[a].origin, p, 8);
+		memcpy(&axes[a].scale, p + 8, 8);
+		p += 16;
+		assert(axes[a].bits == 8 || axes[a].bits == 16 || axes[a].bits == 24 || axes[a].bits == 32);
+		length += (size_t)count * (axes[a].bits / 8);
+	}
+	assert(payload.size() == length);
+	
+	vector<float> coords((size_t)count * 3);
+	for (int a = 0; a < 3; a++) {
+		decodeGridAxis(p, axes[a], count, coords.data() + a);
+		p += (size_t)count * (axes[a].bits / 8);
+	}
+	
+	reserveMore(mesh->v, count);
+	for (size_t i = 0; i < count; i++) {
+		mesh->v.push_back(make_shared<Vertex>(coords[i*3], coords[i*3 + 1], coords[i*3 + 2]));
+	}
+}
+
+
+// Quantized vertex list (type 8): each vertex is 3*bits bits of a little-endian bit stream, x lowest.
+static void readQuantizedVertices(Mesh* mesh, vector<uint8_t>& payload) {
+	assert(payload.size() >= 4 + 1 + 4 + 24);
+	const uint8_t* p = payload.data();
+	uint32_t count;
+	memcpy(&count, p, 4);
+	uint8_t bits = p[4];
+	assert(bits >= 1 && bits <= 16);
+	// p[5..8] is the stated maximum error, only of interest to people.
+	float origin[3], step[3];
+	memcpy(origin, p + 9, 12);
+	memcpy(step, p + 21, 12);
+	size_t header = 4 + 1 + 4 + 24;
+	size_t vertBits = 3 * bits;
+	assert(payload.size() == header + ((size_t)count * vertBits + 7) / 8);
+	
+	// Pad so every vertex can be pulled out with one 8-byte load.
+	payload.resize(payload.size() + 8, 0);
+	p = payload.data() + header;
+	
+	vector<uint32_t> ints((size_t)count * 3 + 12);
+	uint64_t mask = (1u << bits) - 1;
+	for (size_t i = 0; i < count; i++) {
+		size_t bit = i * vertBits;
+		uint64_t word;
+		memcpy(&word, p + (bit >> 3), 8);
+		word >>= bit & 7;
+		ints[i*3] = word & mask;
+		ints[i*3 + 1] = (word >> bits) & mask;
+		ints[i*3 + 2] = (word >> (bits*2)) & mask;
+	}
+	
+	vector<float> coords(ints.size());
+	size_t n = (size_t)count * 3;
+	size_t i = 0;
+	#ifdef SML_SSE2
+	// Three registers cover four vertices, so the per-axis constants repeat as xyzx yzxy zxyz.
+	__m128 o[3], s[3];
+	for (int r = 0; r < 3; r++) {
+		o[r] = _mm_setr_ps(origin[(r*4) % 3], origin[(r*4 + 1) % 3], origin[(r*4 + 2) % 3], origin[(r*4 + 3) % 3]);
+		s[r] = _mm_setr_ps(step[(r*4) % 3], step[(r*4 + 1) % 3], step[(r*4 + 2) % 3], step[(r*4 + 3) % 3]);
+	}
+	for (; i + 12 <= n; i += 12) {
+		for (int r = 0; r < 3; r++) {
+			__m128 q = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)&ints[i + r*4]));
+			_mm_storeu_ps(&coords[i + r*4], _mm_add_ps(o[r], _mm_mul_ps(q, s[r])));
+		}
+	}
+	#endif
+	for (; i < n; i++) {
+		coords[i] = origin[i % 3] + (float)ints[i] * step[i % 3];
+	}
+	
+	reserveMore(mesh->v, count);
+	for (size_t i = 0; i < count; i++) {
+		mesh->v.push_back(make_shared<Vertex>(coords[i*3], coords[i*3 + 1], coords[i*3 + 2]));
+	}
+}
+
+
+// Stream VByte: a 2-bit byte count for each value, four to a control byte, then the low 1-4 bytes of each value.
+// The control bytes all come first so a decoder can find every value's position without touching the data.
+static void encodeVarints(const vector<uint32_t>& in, vector<uint8_t>& out) {
+	size_t count = in.size();
+	size_t ctrl = out.size();
+	out.resize(out.size() + (count + 3) / 4, 0);
+	for (size_t i = 0; i < count; i++) {
+		uint32_t v = in[i];
+		uint8_t bytes = v < (1 << 8) ? 1 : v < (1 << 16) ? 2 : v < (1 << 24) ? 3 : 4;
+		out[ctrl + i/4] |= (bytes - 1) << ((i & 3) * 2);
+		for (uint8_t b = 0; b < bytes; b++) {
+			out.push_back(v >> (b * 8));
+		}
+	}
+}
+
+// Replaces each value with the zigzagged difference from the one before it.
+static void deltaEncode(vector<uint32_t>& values) {
+	uint32_t prev = 0;
+	for (uint32_t& v : values) {
+		int32_t delta = v - prev;
+		prev = v;
+		v = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+	}
+}
+
+#ifdef SML_SSE2
+static bool haveSSSE3() {
+	#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return info[2] & (1 << 9);
+	#else
+	return __builtin_cpu_supports("ssse3");
+	#endif
+}
+
+// For each control byte, the shuffle that spreads its four values' bytes out into 32-bit lanes, and their total size.
+struct VarintTables {
+	alignas(16) uint8_t shuffle[256][16];
+	uint8_t length[256];
+	
+	VarintTables() {
+		for (int c = 0; c < 256; c++) {
+			uint8_t pos = 0;
+			for (int lane = 0; lane < 4; lane++) {
+				uint8_t bytes = ((c >> (lane * 2)) & 3) + 1;
+				for (int b = 0; b < 4; b++) {
+					shuffle[c][lane*4 + b] = b < bytes ? pos + b : 0x80;
+				}
+				pos += bytes;
+			}
+			length[c] = pos;
+		}
+	}
+};
+static const VarintTables varintTables;
+
+SML_TARGET_SSSE3 static const uint8_t* decodeVarintsSSSE3(const uint8_t* ctrl, const uint8_t* data, const uint8_t* end, size_t& i, size_t count, uint32_t* out) {
+	for (; i + 4 <= count && data + 16 <= end; i += 4) {
+		uint8_t c = ctrl[i / 4];
+		__m128i bytes = _mm_loadu_si128((const __m128i*)data);
+		__m128i values = _mm_shuffle_epi8(bytes, _mm_load_si128((const __m128i*)varintTables.shuffle[c]));
+		_mm_storeu_si128((__m128i*)(out + i), values);
+		data += varintTables.length[c];
+	}
+	return data;
+}
+#endif
+
+// Decodes count values written by encodeVarints, returning the end of them.
+// Reads up to 16 bytes past the last value if they are there, so pad buffers if you want the fast path all the way.
+static const uint8_t* decodeVarints(const uint8_t* in, const uint8_t* end, size_t count, uint32_t* out) {
+	const uint8_t* ctrl = in;
+	const uint8_t* data = in + (count + 3) / 4;
+	assert(data <= end);
+	size_t i = 0;
+	#ifdef SML_SSE2
+	static const bool ssse3 = haveSSSE3();
+	if (ssse3) data = decodeVarintsSSSE3(ctrl, data, end, i, count, out);
+	#endif
+	for (; i < count; i++) {
+		uint8_t bytes = ((ctrl[i / 4] >> ((i & 3) * 2)) & 3) + 1;
+		assert(data + bytes <= end);
+		uint32_t v = 0;
+		for (uint8_t b = 0; b < bytes; b++) {
+			v |= (uint32_t)data[b] << (b * 8);
+		}
+		out[i] = v;
+		data += bytes;
+	}
+	return data;
+}
+
+// Undoes deltaEncode: unzigzag, then a running sum.
+static void deltaDecode(uint32_t* values, size_t count) {
+	size_t i = 0;
+	uint32_t prev = 0;
+	#ifdef SML_SSE2
+	__m128i one = _mm_set1_epi32(1);
+	__m128i zero = _mm_setzero_si128();
+	__m128i last = zero;
+	for (; i + 4 <= count; i += 4) {
+		__m128i z = _mm_loadu_si128((const __m128i*)(values + i));
+		__m128i d = _mm_xor_si128(_mm_srli_epi32(z, 1), _mm_sub_epi32(zero, _mm_and_si128(z, one)));
+		d = _mm_add_epi32(d, _mm_slli_si128(d, 4));
+		d = _mm_add_epi32(d, _mm_slli_si128(d, 8));
+		d = _mm_add_epi32(d, last);
+		_mm_storeu_si128((__m128i*)(values + i), d);
+		last = _mm_shuffle_epi32(d, 0xFF);
+	}
+	if (i > 0) prev = values[i - 1];
+	#endif
+	for (; i < count; i++) {
+		uint32_t z = values[i];
+		prev += (z >> 1) ^ (0 - (z & 1));
+		values[i] = prev;
+	}
+}
+
+// Expands one strip of (points) indices, as stored in types 5, 6 and 10, into triangles.
+// In a joined strip, triangles with a repeated index are only there to link strips together and are dropped.
+static void addStrip(Mesh* mesh, const uint32_t* indices, uint32_t points, bool joined) {
+	assert(points >= 3);
+	uint32_t verts[3];
+	memcpy(verts, indices, 12);
+	mesh->t.push_back(make_shared<Triangle>(verts));
+	for (uint32_t i = 3; i < points; i++) {
+		/* i=0  0 1 2
+		   i=3  0 2 3	2->1
+		   i=4  3 2 4	2->0 */
+		verts[i & 1] = verts[2];
+		verts[2] = indices[i];
+		if (joined && (verts[0] == verts[1] || verts[1] == verts[2] || verts[2] == verts[0])) continue;
+		mesh->t.push_back(make_shared<Triangle>(verts));
+	}
+}
+
+// Varint triangle list (type 9).
+static void readVarintTriangles(Mesh* mesh, vector<uint8_t>& payload) {
+	assert(payload.size() >= 4);
+	size_t size = payload.size();
+	payload.resize(size + 16, 0);
+	uint32_t count;
+	memcpy(&count, payload.data(), 4);
+	
+	vector<uint32_t> indices((size_t)count * 3);
+	const uint8_t* end = decodeVarints(payload.data() + 4, payload.data() + payload.size(), indices.size(), indices.data());
+	assert(end == payload.data() + size);
+	deltaDecode(indices.data(), indices.size());
+	
+	reserveMore(mesh->t, count);
+	for (size_t i = 0; i < count; i++) {
+		mesh->t.push_back(make_shared<Triangle>(&indices[i*3]));
+	}
+}
+
+// Varint packed triangle strips (type 10).
+static void readVarintStrips(Mesh* mesh, vector<uint8_t>& payload) {
+	assert(payload.size() >= 8);
+	size_t size = payload.size();
+	payload.resize(size + 16, 0);
+	uint32_t count, points;
+	memcpy(&count, payload.data(), 4);
+	memcpy(&points, payload.data() + 4, 4);
+	
+	const uint8_t* end = payload.data() + payload.size();
+	vector<uint32_t> lengths(count);
+	const uint8_t* p = decodeVarints(payload.data() + 8, end, count, lengths.data());
+	vector<uint32_t> indices(points);
+	p = decodeVarints(p, end, points, indices.data());
+	assert(p == payload.data() + size);
+	deltaDecode(indices.data(), indices.size());
+	
+	size_t pos = 0;
+	for (uint32_t length : lengths) {
+		uint32_t n = length & 0x7FFFFFFF;
+		assert(pos + n <= points);
+		addStrip(mesh, &indices[pos], n, length & 0x80000000);
+		pos += n;
+	}
+	assert(pos == points);
+}
+
+// Triangle fans (type 20).
+static void readFans(Mesh* mesh, vector<uint8_t>& payload) {
+	assert(payload.size() >= 8);
+	size_t size = payload.size();
+	payload.resize(size + 16, 0);
+	uint32_t count, points;
+	memcpy(&count, payload.data(), 4);
+	memcpy(&points, payload.data() + 4, 4);
+	
+	const uint8_t* end = payload.data() + payload.size();
+	vector<uint32_t> lengths(count);
+	const uint8_t* p = decodeVarints(payload.data() + 8, end, count, lengths.data());
+	vector<uint32_t> indices(points);
+	p = decodeVarints(p, end, points, indices.data());
+	assert(p == payload.data() + size);
+	deltaDecode(indices.data(), indices.size());
+	
+	reserveMore(mesh->t, points - (size_t)count * 2);
+	size_t pos = 0;
+	for (uint32_t n : lengths) {
+		assert(n >= 3 && pos + n <= points);
+		const uint32_t* fan = &indices[pos];
+		for (uint32_t i = 2; i < n; i++) {
+			mesh->t.push_back(make_shared<Triangle>(fan[0], fan[i - 1], fan[i]));
+		}
+		pos += n;
+	}
+	assert(pos == points);
+}
+
+
+// Maps float bits to an unsigned integer in the same order as the floats, so that nearby values have nearby integers.
+static inline uint32_t floatOrder(uint32_t bits) {
+	return bits ^ ((uint32_t)((int32_t)bits >> 31) | 0x80000000);
+}
+static inline uint32_t floatUnorder(uint32_t key) {
+	return key & 0x80000000 ? key ^ 0x80000000 : ~key;
+}
+
+// Walks the triangles, then the quads, in order, and calls visit(vertex, prediction) for each vertex in
+// [base, base+count) the first time it's used. visit has to fill in pos[vertex*3] before returning.
+// A vertex across an edge shared with the previous triangle, which is every one in a strip, is predicted as the
+// parallelogram completing that triangle. Otherwise it's predicted from what else is known nearby.
+// Vertices nothing uses come last, in order.
+template<class Visit>
+static void predictVertices(const vector<shared_ptr<Triangle>>& tris, const vector<shared_ptr<Quad>>& quads, size_t base, size_t count, float* pos, Visit visit) {
+	vector<uint8_t> known(count, 0);
+	float zero[3] = { 0, 0, 0 };
+	const float* last = zero;
+	float pred[3];
+	
+	auto local = [&](uint32_t i) -> int64_t {
+		return i >= base && i - base < count ? (int64_t)(i - base) : -1;
+	};
+	
+	int64_t prev[3] = { -1, -1, -1 };
+	for (auto& t : tris) {
+		int64_t v[3] = { local(t->a), local(t->b), local(t->c) };
+		for (int k = 0; k < 3; k++) {
+			if (v[k] < 0 || known[v[k]]) continue;
+			int64_t x = v[(k+1) % 3];
+			int64_t y = v[(k+2) % 3];
+			bool kx = x >= 0 && known[x];
+			bool ky = y >= 0 && known[y];
+			
+			if (kx && ky) {
+				int64_t o = -1;
+				for (int j = 0; j < 3; j++) {
+					int64_t p1 = prev[(j+1) % 3];
+					int64_t p2 = prev[(j+2) % 3];
+					if (prev[j] >= 0 && prev[j] != x && prev[j] != y && ((p1 == x && p2 == y) || (p1 == y && p2 == x))) {
+						o = prev[j];
+					}
+				}
+				for (int a = 0; a < 3; a++) {
+					if (o >= 0) {
+						pred[a] = (pos[x*3 + a] + pos[y*3 + a]) - pos[o*3 + a];
+					} else {
+						pred[a] = (pos[x*3 + a] + pos[y*3 + a]) * 0.5f;
+					}
+				}
+			} else if (kx || ky) {
+				memcpy(pred, &pos[(kx ? x : y) * 3], 12);
+			} else {
+				memcpy(pred, last, 12);
+			}
+			
+			visit(v[k], pred);
+			known[v[k]] = 1;
+			last = &pos[v[k] * 3];
+		}
+		memcpy(prev, v, sizeof(v));
+	}
+	
+	for (auto& q : quads) {
+		for (uint32_t i : q->v) {
+			int64_t v = local(i);
+			if (v < 0 || known[v]) continue;
+			memcpy(pred, last, 12);
+			visit(v, pred);
+			known[v] = 1;
+			last = &pos[v * 3];
+		}
+	}
+	
+	for (size_t v = 0; v < count; v++) {
+		if (known[v]) continue;
+		memcpy(pred, last, 12);
+		visit(v, pred);
+		last = &pos[v * 3];
+	}
+}
+
+// Predicted vertex list (type 12).
+static void readPredictedVertices(Mesh* mesh, vector<uint8_t>& payload) {
+	assert(payload.size() >= 4);
+	size_t size = payload.size();
+	payload.resize(size + 16, 0);
+	uint32_t count;
+	memcpy(&count, payload.data(), 4);
+	
+	vector<uint32_t> residuals((size_t)count * 3);
+	const uint8_t* end = decodeVarints(payload.data() + 4, payload.data() + payload.size(), residuals.size(), residuals.data());
+	assert(end == payload.data() + size);
+	
+	size_t base = mesh->v.size();
+	vector<float> pos((size_t)count * 3);
+	const uint32_t* r = residuals.data();
+	predictVertices(mesh->t, mesh->q, base, count, pos.data(), [&](size_t v, const float* pred) {
+		for (int a = 0; a < 3; a++) {
+			uint32_t bits;
+			memcpy(&bits, &pred[a], 4);
+			uint32_t z = *r++;
+			bits = floatUnorder(floatOrder(bits) + ((z >> 1) ^ (0 - (z & 1))));
+			memcpy(&pos[v*3 + a], &bits, 4);
+		}
+	});
+	
+	reserveMore(mesh->v, count);
+	for (size_t i = 0; i < count; i++) {
+		mesh->v.push_back(make_shared<Vertex>(pos[i*3], pos[i*3 + 1], pos[i*3 + 2]));
+	}
+}
+
+
+// Compressed segments (type 11) are cut into blocks of this many raw bytes, each coded on its own so they can be
+// done in parallel.
+#define SML_COMPRESS_BLOCK (1024*1024)
+
+// How far apart the bytes that belong together are in each segment type, for splitting into byte planes.
+static unsigned int segmentStride(uint8_t type) {
+	switch (type) {
+		case 1: case 3: case 4: case 5: case 6:
+			return 4;
+		case 2:
+			return 8;
+		default:
+			return 1;
+	}
+}
+
+// Runs job(0..count-1) across up to (threads) threads.
+template<class Job>
+static void parallelFor(size_t count, unsigned int threads, Job job) {
+	if (threads > count) threads = count;
+	if (threads <= 1) {
+		for (size_t i = 0; i < count; i++) job(i);
+		return;
+	}
+	vector<thread> workers;
+	for (unsigned int t = 0; t < threads; t++) {
+		workers.emplace_back([&, t]() {
+			for (size_t i = t; i < count; i += threads) job(i);
+		});
+	}
+	for (auto& worker : workers) worker.join();
+}
+
+// Builds a compressed segment (type 11) payload wrapping a segment of the given type.
+static void compressSegment(uint8_t type, const vector<uint8_t>& raw, vector<uint8_t>& out, unsigned int threads) {
+	unsigned int stride = segmentStride(type);
+	size_t blocks = (raw.size() + SML_COMPRESS_BLOCK - 1) / SML_COMPRESS_BLOCK;
+	vector<vector<uint8_t>> coded(blocks);
+	parallelFor(blocks, threads, [&](size_t b) {
+		size_t start = b * SML_COMPRESS_BLOCK;
+		ransCompress(raw.data() + start, min((size_t)SML_COMPRESS_BLOCK, raw.size() - start), stride, coded[b]);
+	});
+	
+	out.clear();
+	out.push_back(type);
+	out.push_back(stride);
+	uint32_t rawLength = raw.size();
+	uint32_t blockSize = SML_COMPRESS_BLOCK;
+	out.insert(out.end(), (uint8_t*)&rawLength, (uint8_t*)&rawLength + 4);
+	out.insert(out.end(), (uint8_t*)&blockSize, (uint8_t*)&blockSize + 4);
+	for (auto& block : coded) {
+		uint32_t size = block.size();
+		out.insert(out.end(), (uint8_t*)&size, (uint8_t*)&size + 4);
+	}
+	for (auto& block : coded) {
+		out.insert(out.end(), block.begin(), block.end());
+	}
+}
+
+static void decompressSegment(const vector<uint8_t>& payload, uint8_t& type, vector<uint8_t>& raw, unsigned int threads) {
+	assert(payload.size() >= 10);
+	const uint8_t* p = payload.data();
+	type = p[0];
+	unsigned int stride = p[1];
+	uint32_t rawLength, blockSize;
+	memcpy(&rawLength, p + 2, 4);
+	memcpy(&blockSize, p + 6, 4);
+	assert(stride >= 1 && blockSize > 0);
+	
+	size_t blocks = ((size_t)rawLength + blockSize - 1) / blockSize;
+	assert(payload.size() >= 10 + blocks * 4);
+	vector<size_t> offsets(blocks + 1);
+	offsets[0] = 10 + blocks * 4;
+	for (size_t b = 0; b < blocks; b++) {
+		uint32_t size;
+		memcpy(&size, p + 10 + b*4, 4);
+		offsets[b+1] = offsets[b] + size;
+	}
+	assert(offsets[blocks] == payload.size());
+	
+	raw.resize(rawLength);
+	atomic<bool> ok(true);
+	parallelFor(blocks, threads, [&](size_t b) {
+		size_t start = b * blockSize;
+		if (!ransDecompress(p + offsets[b], offsets[b+1] - offsets[b], raw.data() + start, min((size_t)blockSize, raw.size() - start), stride)) {
+			ok = false;
+		}
+	});
+	if (!ok) {
+		fprintf(stderr, "Error: Compressed segment is corrupt.\n");
+		exit(__LINE__);
+	}
+}
+
+// A refinement adds vertices back one at a time, each one split off from a vertex already there: its triangles that
+// should have it instead are changed over, and the triangles between the two are added.
+static void readRefinement(Mesh* mesh, vector<uint8_t>& payload) {
+	assert(payload.size() >= 8);
+	size_t size = payload.size();
+	uint32_t splits, count;
+	memcpy(&splits, payload.data(), 4);
+	memcpy(&count, payload.data() + 4, 4);
+	assert(size >= 8 + (size_t)splits * 12);
+	payload.resize(size + 16, 0);
+	
+	vector<uint32_t> values(count);
+	const uint8_t* end = decodeVarints(payload.data() + 8 + (size_t)splits * 12, payload.data() + payload.size(), count, values.data());
+	assert(end == payload.data() + size);
+	
+	size_t base = mesh->v.size();
+	reserveMore(mesh->v, splits);
+	for (uint32_t i = 0; i < splits; i++) {
+		shared_ptr<Vertex> v = make_shared<Vertex>();
+		memcpy(v->c, payload.data() + 8 + (size_t)i * 12, 12);
+		mesh->v.push_back(v);
+	}
+	
+	size_t pos = 0;
+	auto next = [&]() -> uint32_t {
+		if (pos >= values.size()) {
+			fprintf(stderr, "Error: Malformed refinement segment.\n");
+			exit(__LINE__);
+		}
+		return values[pos++];
+	};
+	for (uint32_t i = 0; i < splits; i++) {
+		uint32_t u = base + i;
+		uint32_t v = next();
+		uint32_t changed = next();
+		for (uint32_t k = 0; k < changed; k++) {
+			uint32_t t = next();
+			assert(t < mesh->t.size());
+			Triangle* tri = mesh->t[t].get();
+			for (uint32_t& w : tri->v) {
+				if (w == v) w = u;
+			}
+		}
+		uint32_t added = next();
+		for (uint32_t k = 0; k < added; k++) {
+			shared_ptr<Triangle> t = make_shared<Triangle>();
+			t->a = next();
+			t->b = next();
+			t->c = next();
+			mesh->t.push_back(t);
+		}
+	}
+	assert(pos == values.size());
+}
+
+// Double-precision vertex list (type 2), rounded to floats.
+static void readDoubleVertices(Mesh* mesh, const uint8_t* p, size_t count) {
+	size_t n = count * 3;
+	vector<float> coords(n);
+	size_t i = 0;
+	#ifdef SML_SSE2
+	for (; i + 4 <= n; i += 4) {
+		__m128d lo = _mm_loadu_pd((const double*)(p + i*8));
+		__m128d hi = _mm_loadu_pd((const double*)(p + i*8 + 16));
+		_mm_storeu_ps(&coords[i], _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi)));
+	}
+	#endif
+	for (; i < n; i++) {
+		double d;
+		memcpy(&d, p + i*8, 8);
+		coords[i] = (float)d;
+	}
+	
+	reserveMore(mesh->v, count);
+	for (size_t i = 0; i < count; i++) {
+		mesh->v.push_back(make_shared<Vertex>(coords[i*3], coords[i*3 + 1], coords[i*3 + 2]));
+	}
+	
+	// Only the ones that didn't fit in a float exactly count as rounded.
+	for (size_t i = 0; i < count; i++) {
+		for (int axis = 0; axis < 3; axis++) {
+			double d;
+			memcpy(&d, p + (i*3 + axis)*8, 8);
+			if ((double)coords[i*3 + axis] != d && d == d) {
+				mesh->rounded++;
+				break;
+			}
+		}
+	}
+}
+
+// Moves everything in part onto the end of mesh. With rebase, part's indices are taken to start from its own first vertex.
+static void appendMesh(Mesh* mesh, Mesh& part, bool rebase) {
+	if (mesh->v.size() + part.v.size() > SML_MAX_VERTICES) {
+		fprintf(stderr, "Error: More than %llu vertices, which 32-bit indices can't reach.\n", SML_MAX_VERTICES);
+		exit(__LINE__);
+	}
+	if (rebase && !mesh->v.empty()) {
+		uint32_t base = mesh->v.size();
+		for (auto& t : part.t) {
+			t->a += base;
+			t->b += base;
+			t->c += base;
+		}
+		for (auto& q : part.q) {
+			for (uint32_t& v : q->v) v += base;
+		}
+	}
+	mesh->comments.insert(mesh->comments.end(), make_move_iterator(part.comments.begin()), make_move_iterator(part.comments.end()));
+	mesh->v.insert(mesh->v.end(), make_move_iterator(part.v.begin()), make_move_iterator(part.v.end()));
+	mesh->t.insert(mesh->t.end(), make_move_iterator(part.t.begin()), make_move_iterator(part.t.end()));
+	mesh->q.insert(mesh->q.end(), make_move_iterator(part.q.begin()), make_move_iterator(part.q.end()));
+	mesh->rounded += part.rounded;
+	part.rounded = 0;
+	part.comments.clear();
+	part.v.clear();
+	part.t.clear();
+	part.q.clear();
+}
+
+// Threads is for decompressing; inside a parallel loop it should be 1, so as not to start threads on top of threads.
+static void readSegment(Mesh* mesh, uint8_t type, vector<uint8_t>& payload, unsigned int threads);
+
+// Reads the segments nested in a tile or instance segment from (pos) on, into a mesh of their own.
+static void readNested(Mesh* part, vector<uint8_t>& payload, size_t pos, const char* what, unsigned int threads) {
+	vector<uint8_t> inner;
+	while (pos < payload.size()) {
+		assert(pos + 5 <= payload.size());
+		uint8_t type = payload[pos];
+		uint32_t length;
+		memcpy(&length, &payload[pos + 1], 4);
+		assert(pos + 5 + length <= payload.size());
+		if (type >= 14 && type <= 19) {
+			fprintf(stderr, "Error: Segment type '%hhu' can't be inside %s.\n", type, what);
+			exit(__LINE__);
+		}
+		inner.assign(payload.begin() + pos + 5, payload.begin() + pos + 5 + length);
+		readSegment(part, type, inner, threads);
+		pos += 5 + length;
+	}
+}
+
+// A tile is a bounding box followed by segments of its own, whose indices count from the tile's first vertex.
+static void readTile(Mesh* mesh, vector<uint8_t>& payload, unsigned int threads) {
+	assert(payload.size() >= 24);
+	Mesh tile;
+	readNested(&tile, payload, 24, "a tile", threads);
+	appendMesh(mesh, tile, true);
+}
+
+// An instance segment is a list of offsets followed by segments holding one shape, which is added once as it is and
+// again moved by each offset.
+static void readInstances(Mesh* mesh, vector<uint8_t>& payload, unsigned int threads) {
+	assert(payload.size() >= 4);
+	uint32_t count;
+	memcpy(&count, payload.data(), 4);
+	size_t pos = 4 + (size_t)count * 12;
+	assert(pos <= payload.size());
+	Mesh shape;
+	readNested(&shape, payload, pos, "an instance segment", threads);
+	
+	size_t verts = shape.v.size(), tris = shape.t.size(), quads = shape.q.size();
+	if (verts * ((size_t)count + 1) > SML_MAX_VERTICES) {
+		fprintf(stderr, "Error: More than %llu vertices, which 32-bit indices can't reach.\n", SML_MAX_VERTICES);
+		exit(__LINE__);
+	}
+	shape.v.reserve(verts * ((size_t)count + 1));
+	shape.t.reserve(tris * ((size_t)count + 1));
+	shape.q.reserve(quads * ((size_t)count + 1));
+	for (uint32_t k = 0; k < count; k++) {
+		float d[3];
+		memcpy(d, payload.data() + 4 + (size_t)k * 12, 12);
+		uint32_t base = verts * (k + 1);
+		for (size_t i = 0; i < verts; i++) {
+			const float* c = shape.v[i]->c;
+			shape.v.push_back(make_shared<Vertex>(c[0] + d[0], c[1] + d[1], c[2] + d[2]));
+		}
+		for (size_t i = 0; i < tris; i++) {
+			Triangle* t = shape.t[i].get();
+			shape.t.push_back(make_shared<Triangle>(t->a + base, t->b + base, t->c + base));
+		}
+		for (size_t i = 0; i < quads; i++) {
+			shared_ptr<Quad> q = make_shared<Quad>();
+			for (int j = 0; j < 4; j++) q->v[j] = shape.q[i]->v[j] + base;
+			shape.q.push_back(q);
+		}
+	}
+	appendMesh(mesh, shape, true);
+}
+
+// Decodes one segment's payload into the mesh. The payload may be padded in place by the decoders.
+static void readSegment(Mesh* mesh, uint8_t type, vector<uint8_t>& payload, unsigned int threads) {
+	size_t length = payload.size();
+	const uint8_t* p = payload.data();
+	
+	switch (type) {
+		case 0: {
+			mesh->comments.emplace_back((const char*)p, strnlen((const char*)p, length));
+		} break;
+		
+		case 1: { // Vertex float list
+			size_t verts = length / 12;
+			reserveMore(mesh->v, verts);
+			for (size_t i = 0; i < verts; i++) {
+				shared_ptr<Vertex> v = make_shared<Vertex>();
+				memcpy(v->c, p + i*12, 12);
+				mesh->v.push_back(v);
+			}
+		} break;
+		
+		case 2: { // Vertex double list; here we're just dumping the extra precision and converting to floats.
+			readDoubleVertices(mesh, p, length / 24);
+		} break;
+		
+		case 3: { // Triangle list
+			size_t tris = length / 12;
+			reserveMore(mesh->t, tris);
+			for (size_t i = 0; i < tris; i++) {
+				shared_ptr<Triangle> t = make_shared<Triangle>();
+				memcpy(t->v, p + i*12, 12);
+				mesh->t.push_back(t);
+			}
+		} break;
+		
+		case 4: { // Quad list
+			size_t quads = length / 16;
+			reserveMore(mesh->q, quads);
+			for (size_t i = 0; i < quads; i++) {
+				shared_ptr<Quad> q = make_shared<Quad>();
+				memcpy(q->v, p + i*16, 16);
+				mesh->q.push_back(q);
+			}
+		} break;
+		
+		case 5: { // Triangle strip
+			size_t points = length / 4;
+			vector<uint32_t> indices(points);
+			memcpy(indices.data(), p, points * 4);
+			addStrip(mesh, indices.data(), points, false);
+		} break;
+		
+		case 6: { // Packed triangle strips
+			assert(length >= 4);
+			uint32_t count;
+			memcpy(&count, p, 4);
+			assert(length >= 4 + (size_t)count * 4);
+			vector<uint32_t> lengths(count);
+			memcpy(lengths.data(), p + 4, (size_t)count * 4);
+			
+			size_t points = (length - 4 - (size_t)count * 4) / 4;
+			vector<uint32_t> indices(points);
+			memcpy(indices.data(), p + 4 + (size_t)count * 4, points * 4);
+			size_t pos = 0;
+			for (uint32_t stripLength : lengths) {
+				uint32_t n = stripLength & 0x7FFFFFFF;
+				assert(pos + n <= points);
+				addStrip(mesh, &indices[pos], n, stripLength & 0x80000000);
+				pos += n;
+			}
+		} break;
+		
+		case 7: // Grid vertex list
+			readGridVertices(mesh, payload);
+			break;
+		
+		case 8: // Quantized vertex list
+			readQuantizedVertices(mesh, payload);
+			break;
+		
+		case 9: // Varint triangle list
+			readVarintTriangles(mesh, payload);
+			break;
+		
+		case 10: // Varint packed triangle strips
+			readVarintStrips(mesh, payload);
+			break;
+		
+		case 11: { // Compressed segment
+			uint8_t inner;
+			vector<uint8_t> raw;
+			decompressSegment(payload, inner, raw, threads);
+			assert(inner != 11);
+			readSegment(mesh, inner, raw, threads);
+		} break;
+		
+		case 12: // Predicted vertex list
+			readPredictedVertices(mesh, payload);
+			break;
+		
+		case 13: // Edgebreaker triangles
+			if (!edgebreakerDecode(mesh, payload.data(), payload.size())) {
+				fprintf(stderr, "Error: Malformed Edgebreaker segment.\n");
+				exit(__LINE__);
+			}
+			break;
+		
+		case 14: // Segment index; only needed for random access.
+		case 15: // Tile directory; likewise.
+		case 17: // Stats; only needed without the mesh.
+			break;
+		
+		case 18: // Refinement
+			readRefinement(mesh, payload);
+			break;
+		
+		case 16: // Tile
+			readTile(mesh, payload, threads);
+			break;
+		
+		case 19: // Instances
+			readInstances(mesh, payload, threads);
+			break;
+		
+		case 20: // Triangle fans
+			readFans(mesh, payload);
+			break;
+		
+		default:
+			fprintf(stderr, "Error: Unrecognized segment type '%hhu'\n", type);
+			exit(__LINE__);
+	}
+}
+
+struct IndexEntry {
+	uint64_t offset;	// Of the segment's type byte, from the start of the file.
+	uint32_t length;
+	uint8_t type;
+	uint8_t inner;		// The type inside a compressed segment, otherwise the same as type.
+	uint32_t elements;	// Vertices, triangles or quads it holds.
+	uint32_t crc;		// CRC32C of the payload.
+};
+#define SML_INDEX_ENTRY 22
+
+// Reads the segment index (type 14) from the end of the file, if there is one.
+// Returns false if there isn't, or if it doesn't account for every byte of the file.
+static bool readIndex(FILE* fp, vector<IndexEntry>& index) {
+	fseek64(fp, 0, SEEK_END);
+	uint64_t size = ftell64(fp);
+	if (size < 8 + 5 + 12) return false;
+	
+	uint8_t trailer[12];
+	fseek64(fp, size - 12, SEEK_SET);
+	if (fread(trailer, 1, 12, fp) != 12 || memcmp(trailer + 8, "SMLI", 4)) return false;
+	uint32_t count, crc;
+	memcpy(&count, trailer, 4);
+	memcpy(&crc, trailer + 4, 4);
+	uint64_t length = (uint64_t)count * SML_INDEX_ENTRY + 12;
+	if (length + 5 + 8 > size) return false;
+	
+	uint8_t type;
+	uint32_t headerLength;
+	fseek64(fp, size - length - 5, SEEK_SET);
+	if (fread(&type, 1, 1, fp) != 1 || fread(&headerLength, 4, 1, fp) != 1) return false;
+	if (type != 14 || headerLength != length) return false;
+	vector<uint8_t> entries((size_t)count * SML_INDEX_ENTRY);
+	if (fread(entries.data(), 1, entries.size(), fp) != entries.size()) return false;
+	if (crc32c(0, entries.data(), entries.size()) != crc) {
+		printf("Segment index is damaged, ignoring it.\n");
+		return false;
+	}
+	
+	index.resize(count);
+	uint64_t expect = 8;
+	for (uint32_t i = 0; i < count; i++) {
+		const uint8_t* p = &entries[(size_t)i * SML_INDEX_ENTRY];
+		IndexEntry& entry = index[i];
+		memcpy(&entry.offset, p, 8);
+		memcpy(&entry.length, p + 8, 4);
+		entry.type = p[12];
+		entry.inner = p[13];
+		memcpy(&entry.elements, p + 14, 4);
+		memcpy(&entry.crc, p + 18, 4);
+		if (entry.offset != expect) return false;
+		expect += 5 + (uint64_t)entry.length;
+	}
+	return expect == size - length - 5;
+}
+
+// Reads the segments listed in the index, checking and decoding them in parallel. Predicted vertex lists and refinements
+// depend on the triangles before them, so those are decoded in order as the pieces are put together.
+static void readIndexedSegments(Mesh* mesh, FILE* fp, vector<IndexEntry>& index) {
+	printf("Reading %u indexed segments...", (uint32_t)index.size());
+	fflush(stdout);
+	size_t count = index.size();
+	vector<vector<uint8_t>> payloads(count);
+	for (size_t i = 0; i < count; i++) {
+		uint8_t type;
+		uint32_t length;
+		fseek64(fp, index[i].offset, SEEK_SET);
+		size_t ret = fread(&type, 1, 1, fp);
+		ret += fread(&length, 4, 1, fp);
+		if (ret != 2 || type != index[i].type || length != index[i].length) {
+			fprintf(stderr, "Error: Segment %u doesn't match the index.\n", (uint32_t)i);
+			exit(__LINE__);
+		}
+		payloads[i].resize(length);
+		ret = fread(payloads[i].data(), 1, length, fp);
+		assert(ret == length);
+	}
+	
+	vector<Mesh> parts(count);
+	atomic<bool> ok(true);
+	parallelFor(count, SMLOptions().threads, [&](size_t i) {
+		if (crc32c(0, payloads[i].data(), payloads[i].size()) != index[i].crc) {
+			fprintf(stderr, "Error: CRC mismatch in segment %u.\n", (uint32_t)i);
+			ok = false;
+			return;
+		}
+		if (index[i].inner == 12 || index[i].inner == 18) return;
+		readSegment(&parts[i], index[i].type, payloads[i], 1);
+		vector<uint8_t>().swap(payloads[i]);
+	});
+	if (!ok) exit(__LINE__);
+	
+	size_t verts = 0, tris = 0, quads = 0;
+	for (auto& part : parts) {
+		verts += part.v.size();
+		tris += part.t.size();
+		quads += part.q.size();
+	}
+	mesh->v.reserve(verts);
+	mesh->t.reserve(tris);
+	mesh->q.reserve(quads);
+	for (size_t i = 0; i < count; i++) {
+		if (index[i].inner == 12 || index[i].inner == 18) {
+			readSegment(mesh, index[i].type, payloads[i], SMLOptions().threads);
+			continue;
+		}
+		appendMesh(mesh, parts[i], index[i].type == 16 || index[i].type == 19);
+	}
+	printf("Done.\n");
+}
+
+
+// Opens an SML file and checks its magic, leaving it at the CRC.
+static FILE* openSML(std::filesystem::path file) {
+	#ifdef _WIN32
+		printf("Reading %ls...\n", file.c_str());
+		fflush(stdout);
+		FILE* fp = _wfopen(file.c_str(), L"rb");
+		if (!fp) {
+			fprintf(stderr, "Could not open SML file '%ls' for reading: %s\n", file.c_str(), strerror(errno));
+			exit(__LINE__);
+		}
+	#else
+		printf("Reading %s...\n", file.c_str());
+		fflush(stdout);
+		FILE* fp = fopen(file.c_str(), "r");
+		if (!fp) {
+			fprintf(stderr, "Could not open SML file '%s' for reading: %m\n", file.c_str());
+			exit(__LINE__);
+		}
+	#endif
+	
+	char magic[4];
+	size_t ret = fread(magic, 1, 4, fp);
+	assert(ret == 4);
+	assert(!memcmp(magic, "SML1", 4));
+	return fp;
+}
+
+bool checkSML(std::filesystem::path file) {
+	#ifdef _WIN32
+		FILE* fp = _wfopen(file.c_str(), L"rb");
+	#else
+		FILE* fp = fopen(file.c_str(), "r");
+	#endif
+	if (!fp) {
+		fprintf(stderr, "Error: Could not open SML file '%s' for reading: %s\n", file.string().c_str(), strerror(errno));
+		return false;
+	}
+	
+	char magic[4];
+	uint32_t crc;
+	if (fread(magic, 1, 4, fp) != 4 || memcmp(magic, "SML1", 4) || fread(&crc, 4, 1, fp) != 1) {
+		fprintf(stderr, "Error: '%s' is not an SML file.\n", file.string().c_str());
+		fclose(fp);
+		return false;
+	}
+	
+	vector<char> buffer(1*1024*1024);
+	uint32_t crc2 = 0;
+	size_t len;
+	while ((len = fread(buffer.data(), 1, buffer.size(), fp)) > 0) {
+		crc2 = crc32c(crc2, buffer.data(), len);
+	}
+	fclose(fp);
+	if (crc != crc2) {
+		fprintf(stderr, "Error: CRC mismatch in '%s', read %08x, calculated %08x.\n", file.string().c_str(), crc, crc2);
+		return false;
+	}
+	return true;
+}
+
 Mesh* readSML(std::filesystem::path file) {
 	Mesh* mesh = new Mesh();
+	FILE* fp = openSML(file);
+	
+	uint32_t crc;
+	size_t ret = fread(&crc, 4, 1, fp);
+	assert(ret == 1);
+	
+	// With an index, each segment has its own CRC, and those are checked as it's read instead.
+	vector<IndexEntry> index;
+	if (readIndex(fp, index)) {
+		readIndexedSegments(mesh, fp, index);
+		fclose(fp);
+		return mesh;
+	}
+	fseek64(fp, 8, SEEK_SET);
+	
+	// Check CRC
+	{
+		printf("Computing CRC32C...");
+		fflush(stdout);
+		size_t len;
+		char* buffer = (char*)malloc(1*1024*1024);
+		uint32_t crc2 = 0;
+		while ((len = fread(buffer, 1, (1*1024*1024), fp)) > 0) {
+			crc2 = crc32c(crc2, buffer, len);
+		}
+		free(buffer);
+		printf("read %08x, calculated %08x\n", crc, crc2);
+		assert(crc == crc2);
+		
+		fseek64(fp, 8, SEEK_SET);
+	}
+
+
+	#ifdef _MSC_VER
+	#pragma pack(push, 1)
+	struct {
+		uint8_t type;
+		uint32_t length;
+	} header;
+	#pragma pack(pop)
+	#else
+	struct __attribute__((packed)) {
+		uint8_t type;
+		uint32_t length;
+	} header;
+	#endif
+	vector<uint8_t> payload;
+	while (fread(&header, 5, 1, fp) == 1) {
+		//printf("Reading segment, type %hhu, length %u...", header.type, header.length);
+		//fflush(stdout);
+		
+		payload.resize(header.length);
+		ret = fread(payload.data(), 1, header.length, fp);
+		assert(ret == header.length);
+		readSegment(mesh, header.type, payload, SMLOptions().threads);
+		//printf("Done.\n");
+	}
+	printf("Done.\n");
+	return mesh;
+}
+
+
+
+// Looks for a grid that every value on one axis sits on exactly, trying the common decimal and power-of-two steps.
+// Falls back to 32 bits (plain floats) if there isn't one that fits in 24 bits.
+static GridAxis findGrid(vector<float> values) {
+	GridAxis axis = { 32, 0.0, 0.0 };
+	
+	sort(values.begin(), values.end());
+	values.erase(unique(values.begin(), values.end()), values.end());
+	if (values.empty()) return axis;
+	double lo = values.front();
+	double hi = values.back();
+	if (values.size() == 1) {
+		axis.bits = 8;
+		axis.origin = lo;
+		axis.scale = 1.0;
+		return axis;
+	}
+	
+	double gap = numeric_limits<double>::max();
+	for (size_t i = 1; i < values.size(); i++) {
+		gap = min(gap, (double)values[i] - values[i-1]);
+	}
+	
+	vector<double> candidates;
+	for (int d = -3; d <= 9; d++) {
+		double p = d < 0 ? pow(10.0, -d) : 1.0 / pow(10.0, d);
+		candidates.push_back(5.0 * p);
+		candidates.push_back(2.5 * p);
+		candidates.push_back(2.0 * p);
+		candidates.push_back(p);
+	}
+	for (int e = -10; e <= 30; e++) {
+		candidates.push_back(ldexp(1.0, -e));
+	}
+	candidates.push_back(gap);
+	sort(candidates.begin(), candidates.end(), greater<double>());
+	
+	// How far float rounding can move a gap off the grid.
+	double slack = 2.0 * max(fabs(lo), fabs(hi)) * numeric_limits<float>::epsilon();
+	for (double scale : candidates) {
+		// Every gap has to be a whole number of steps, give or take rounding, so the smallest one is a quick filter.
+		double steps = nearbyint(gap / scale);
+		if (steps < 1 || fabs(gap - steps * scale) > slack) continue;
+		double origin = nearbyint(lo / scale) * scale;
+		if ((hi - origin) / scale >= 16777215.5) continue;
+		
+		bool ok = true;
+		uint32_t maxK = 0;
+		for (float v : values) {
+			double k = nearbyint((v - origin) / scale);
+			if (k < 0 || k > 16777215 || (float)(origin + k * scale) != v) {
+				ok = false;
+				break;
+			}
+			if (k > maxK) maxK = k;
+		}
+		if (!ok) continue;
+		
+		axis.bits = maxK < 256 ? 8 : maxK < 65536 ? 16 : 24;
+		axis.origin = origin;
+		axis.scale = scale;
+		return axis;
+	}
+	return axis;
+}
+
+// Writes the vertices as a grid vertex list (type 7) if any axis fits a grid, otherwise returns false.
+static bool writeGridVertices(FILE* fp, Mesh* mesh, size_t chunk) {
+	size_t vertCount = mesh->v.size();
+	printf("Looking for a vertex grid...");
+	fflush(stdout);
+	
+	GridAxis axes[3];
+	vector<float> values(vertCount);
+	for (int a = 0; a < 3; a++) {
+		for (size_t i = 0; i < vertCount; i++) {
+			values[i] = mesh->v[i]->c[a];
+		}
+		axes[a] = findGrid(values);
+	}
+	if (axes[0].bits == 32 && axes[1].bits == 32 && axes[2].bits == 32) {
+		printf("none found.\n");
+		return false;
+	}
+	printf("%hhu/%hhu/%hhu bits.\n", axes[0].bits, axes[1].bits, axes[2].bits);
+	
+	printf("Writing %u grid vertices...", (uint32_t)vertCount);
+	fflush(stdout);
+	vector<uint8_t> packed;
+	for (size_t start = 0; start < vertCount; start += chunk ? chunk : vertCount) {
+		size_t n = chunk ? min(chunk, vertCount - start) : vertCount;
+		size_t length = 4 + 3*17;
+		for (int a = 0; a < 3; a++) {
+			length += n * (axes[a].bits / 8);
+		}
+		assert(length <= 0xFFFFFFFF);
+		uint8_t type = 7;
+		fwrite(&type, 1, 1, fp);
+		uint32_t gridLength = length;
+		fwrite(&gridLength, 4, 1, fp);
+		uint32_t count = n;
+		fwrite(&count, 4, 1, fp);
+		for (int a = 0; a < 3; a++) {
+			fwrite(&axes[a].bits, 1, 1, fp);
+			fwrite(&axes[a].origin, 8, 1, fp);
+			fwrite(&axes[a].scale, 8, 1, fp);
+		}
+		
+		for (int a = 0; a < 3; a++) {
+			size_t bytes = axes[a].bits / 8;
+			packed.resize(n * bytes);
+			for (size_t i = 0; i < n; i++) {
+				float v = mesh->v[start + i]->c[a];
+				if (bytes == 4) {
+					memcpy(&packed[i*4], &v, 4);
+				} else {
+					uint32_t k = nearbyint((v - axes[a].origin) / axes[a].scale);
+					memcpy(&packed[i*bytes], &k, bytes);
+				}
+			}
+			fwrite(packed.data(), 1, packed.size(), fp);
+		}
+	}
+	printf("Done.\n");
+	return true;
+}
+
+// Picks the bits per axis for QUANTIZE_VERTICES: the ones asked for, or the fewest that get within quantizeError.
+// Returns 0 if even 16 bits can't, with error set to what 16 bits would get within.
+static int quantizeBits(Mesh* mesh, const SMLOptions& options, double& error) {
+	if (mesh->minX > mesh->maxX) mesh->updateBounds();
+	double range = max(max(mesh->maxX - mesh->minX, mesh->maxY - mesh->minY), mesh->maxZ - mesh->minZ);
+	
+	int bits = options.quantizeBits;
+	if (bits == 0) {
+		assert(options.quantizeError > 0);
+		bits = 10;
+		while (bits < 16 && range / ((1 << bits) - 1) / 2 > options.quantizeError) bits++;
+	}
+	error = range / ((1 << bits) - 1) / 2;
+	if (options.quantizeBits == 0 && error > options.quantizeError) return 0;
+	return bits;
+}
+
+// Writes the vertices as a quantized vertex list (type 8), snapped to a 2^bits grid over the bounding box.
+// This is lossy; the largest error is half a step on the widest axis, plus float rounding in the decode.
+static void writeQuantizedVertices(FILE* fp, Mesh* mesh, const SMLOptions& options, size_t chunk) {
+	double error;
+	int bits = quantizeBits(mesh, options, error);
+	assert(bits >= 10 && bits <= 16);
+	float lo[3] = { mesh->minX, mesh->minY, mesh->minZ };
+	float hi[3] = { mesh->maxX, mesh->maxY, mesh->maxZ };
+	
+	uint32_t levels = (1 << bits) - 1;
+	float step[3];
+	float maxError = 0;
+	for (int a = 0; a < 3; a++) {
+		step[a] = (hi[a] - lo[a]) / levels;
+		float rounding = 2 * max(fabs(lo[a]), fabs(hi[a])) * numeric_limits<float>::epsilon();
+		maxError = max(maxError, step[a] / 2 + rounding);
+	}
+	
+	size_t vertCount = mesh->v.size();
+	printf("Writing %u vertices quantized to %d bits, max error %g...", (uint32_t)vertCount, bits, maxError);
+	fflush(stdout);
+	
+	size_t vertBits = 3 * bits;
+	vector<uint8_t> packed;
+	for (size_t start = 0; start < vertCount; start += chunk ? chunk : vertCount) {
+		size_t n = chunk ? min(chunk, vertCount - start) : vertCount;
+		packed.assign((n * vertBits + 7) / 8 + 8, 0);
+		for (size_t i = 0; i < n; i++) {
+			uint64_t word = 0;
+			for (int a = 0; a < 3; a++) {
+				uint64_t q = step[a] > 0 ? (uint64_t)nearbyint((mesh->v[start + i]->c[a] - lo[a]) / step[a]) : 0;
+				if (q > levels) q = levels;
+				word |= q << (a * bits);
+			}
+			size_t bit = i * vertBits;
+			uint64_t existing;
+			memcpy(&existing, &packed[bit >> 3], 8);
+			existing |= word << (bit & 7);
+			memcpy(&packed[bit >> 3], &existing, 8);
+		}
+		packed.resize((n * vertBits + 7) / 8);
+		
+		uint8_t type = 8;
+		fwrite(&type, 1, 1, fp);
+		size_t length = 4 + 1 + 4 + 24 + packed.size();
+		assert(length <= 0xFFFFFFFF);
+		uint32_t quantLength = length;
+		fwrite(&quantLength, 4, 1, fp);
+		uint32_t count = n;
+		fwrite(&count, 4, 1, fp);
+		uint8_t bits8 = bits;
+		fwrite(&bits8, 1, 1, fp);
+		fwrite(&maxError, 4, 1, fp);
+		fwrite(lo, 4, 3, fp);
+		fwrite(step, 4, 3, fp);
+		fwrite(packed.data(), 1, packed.size(), fp);
+	}
+	printf("Done.\n");
+}
+
+// Writes the vertices as double-precision vertex lists (type 2), with the coordinates they were read with if the mesh kept
+// them, otherwise just widened.
+template<class Iterator>
+static void writeDoubleVertices(FILE* fp, Mesh* mesh, Iterator begin, Iterator end) {
+	size_t vertCount = distance(begin, end);
+	vector<double> coords(vertCount * 3);
+	double* d = coords.data();
+	for (auto i = begin; i != end; ++i, d += 3) {
+		if (mesh->precise) {
+			memcpy(d, static_cast<PreciseVertex*>(i->get())->d, 24);
+		} else {
+			d[0] = (*i)->x;
+			d[1] = (*i)->y;
+			d[2] = (*i)->z;
+		}
+	}
+	uint8_t type = 2;
+	fwrite(&type, 1, 1, fp);
+	uint32_t length = vertCount * 24;
+	fwrite(&length, 4, 1, fp);
+	fwrite(coords.data(), 8, coords.size(), fp);
+}
+
+// Most vertices, triangles, quads or fan points in one list segment, even without INDEX. Nothing takes more than about
+// 45 bytes for each (joined varint strips, at worst), so that keeps every segment inside the 4 GB its length allows.
+// Longer lists go in more segments, which carry on from the same vertex base. Tests build with a smaller one.
+#ifndef SML_MAX_CHUNK
+#define SML_MAX_CHUNK (1 << 26)
+#endif
+
+// Calls write(begin, end) on each run of up to (chunk) items in turn, or once on all of them if chunk is 0.
+template<class Container, class Write>
+static void forChunks(Container& items, size_t chunk, Write write) {
+	auto i = items.begin();
+	size_t left = items.size();
+	while (left > 0) {
+		size_t n = chunk ? min(chunk, left) : left;
+		auto end = next(i, n);
+		write(i, end);
+		i = end;
+		left -= n;
+	}
+}
+
+// Writes triangles as a triangle list (type 3).
+template<class Iterator>
+static void writeTriangles(FILE* fp, Iterator begin, Iterator end) {
+	size_t triCount = distance(begin, end);
+	assert(triCount <= 357913941);
+	uint8_t type = 3;
+	fwrite(&type, 1, 1, fp);
+	uint32_t triLength = triCount * 12;
+	fwrite(&triLength, 4, 1, fp);
+	for (auto i = begin; i != end; ++i) {
+		(*i)->write(fp);
+	}
+}
+
+// Writes triangles as a varint triangle list (type 9).
+template<class Iterator>
+static void writeVarintTriangles(FILE* fp, Iterator begin, Iterator end) {
+	vector<uint32_t> indices;
+	for (auto i = begin; i != end; ++i) {
+		indices.insert(indices.end(), (*i)->v, (*i)->v + 3);
+	}
+	deltaEncode(indices);
+	
+	vector<uint8_t> payload(4);
+	uint32_t count = indices.size() / 3;
+	memcpy(&payload[0], &count, 4);
+	encodeVarints(indices, payload);
+	
+	uint8_t type = 9;
+	fwrite(&type, 1, 1, fp);
+	assert(payload.size() <= 0xFFFFFFFF);
+	uint32_t varintLength = payload.size();
+	fwrite(&varintLength, 4, 1, fp);
+	fwrite(payload.data(), 1, payload.size(), fp);
+}
+
+// Writes all the strips as a single type 6 segment, or type 10 with varint.
+// With join, strips are chained into one long strip with degenerate triangles between them. That costs one or two more
+// indices per strip than its length entry would, but gives consumers a single strip to draw.
+static void writePackedStrips(FILE* fp, list<list<Triangle*>>& strips, bool join, bool varint) {
+	vector<uint32_t> lengths;
+	vector<uint32_t> indices;
+	vector<uint32_t> joined;
+	uint32_t joinedCount = 0;
+	Triangle* last = NULL;
+	
+	printf("Packing %u strips...", (unsigned int)strips.size());
+	fflush(stdout);
+	for (auto& strip : strips) {
+		bool degenerate = false;
+		if (join) {
+			for (Triangle* t : strip) {
+				if (t->a == t->b || t->b == t->c || t->c == t->a) {
+					degenerate = true;
+					break;
+				}
+			}
+		}
+		
+		vector<uint32_t>* out = &indices;
+		Triangle* first = strip.front();
+		if (join && !degenerate) {
+			out = &joined;
+			if (joined.empty()) {
+				joined.insert(joined.end(), first->v, first->v + 3);
+			} else {
+				// Bridge from the last triangle (x y z) to this strip's first (b0 b1 b2): "z b1 b1 b0 b2" or "x x b1 b1 b0 b2",
+				// depending on which vertex the next index replaces. Everything in between has a repeated index, and the
+				// strip carries on from b0 b1 b2 the same as it would on its own.
+				if (joined.size() & 1) {
+					joined.push_back(last->a);
+					joined.push_back(last->a);
+				} else {
+					joined.push_back(last->c);
+				}
+				joined.push_back(first->b);
+				joined.push_back(first->b);
+				joined.push_back(first->a);
+				joined.push_back(first->c);
+			}
+			joinedCount++;
+			last = strip.back();
+		} else {
+			lengths.push_back(strip.size() + 2);
+			out->insert(out->end(), first->v, first->v + 3);
+		}
+		
+		for (auto i = next(strip.begin()); i != strip.end(); ++i) {
+			out->push_back((*i)->c);
+		}
+	}
+	
+	if (!joined.empty()) {
+		assert(joined.size() < 0x80000000);
+		lengths.insert(lengths.begin(), joined.size() | (joinedCount > 1 ? 0x80000000 : 0));
+		indices.insert(indices.begin(), joined.begin(), joined.end());
+	}
+	printf("Done.\n");
+	
+	if (varint) {
+		printf("Writing %u varint packed strips...", (unsigned int)lengths.size());
+		fflush(stdout);
+		vector<uint8_t> payload(8);
+		uint32_t count = lengths.size();
+		uint32_t points = indices.size();
+		memcpy(&payload[0], &count, 4);
+		memcpy(&payload[4], &points, 4);
+		encodeVarints(lengths, payload);
+		deltaEncode(indices);
+		encodeVarints(indices, payload);
+		
+		uint8_t type = 10;
+		fwrite(&type, 1, 1, fp);
+		assert(payload.size() <= 0xFFFFFFFF);
+		uint32_t varintLength = payload.size();
+		fwrite(&varintLength, 4, 1, fp);
+		fwrite(payload.data(), 1, payload.size(), fp);
+		printf("Done.\n");
+		return;
+	}
+	
+	printf("Writing %u packed strips...", (unsigned int)lengths.size());
+	fflush(stdout);
+	uint8_t type = 6;
+	fwrite(&type, 1, 1, fp);
+	size_t length = (1 + lengths.size() + indices.size()) * sizeof(uint32_t);
+	assert(length <= 0xFFFFFFFF);
+	uint32_t packedLength = length;
+	fwrite(&packedLength, 4, 1, fp);
+	uint32_t count = lengths.size();
+	fwrite(&count, 4, 1, fp);
+	fwrite(lengths.data(), 4, lengths.size(), fp);
+	fwrite(indices.data(), 4, indices.size(), fp);
+	printf("Done.\n");
+}
+
+// Writes fans, each a centre then its rim, as a triangle fan segment (type 20).
+static void writeFans(FILE* fp, vector<vector<uint32_t>>::iterator begin, vector<vector<uint32_t>>::iterator end) {
+	vector<uint32_t> lengths;
+	vector<uint32_t> indices;
+	for (auto i = begin; i != end; ++i) {
+		lengths.push_back(i->size());
+		indices.insert(indices.end(), i->begin(), i->end());
+	}
+	vector<uint8_t> payload(8);
+	uint32_t count = lengths.size();
+	uint32_t points = indices.size();
+	memcpy(&payload[0], &count, 4);
+	memcpy(&payload[4], &points, 4);
+	encodeVarints(lengths, payload);
+	deltaEncode(indices);
+	encodeVarints(indices, payload);
+	
+	uint8_t type = 20;
+	fwrite(&type, 1, 1, fp);
+	assert(payload.size() <= 0xFFFFFFFF);
+	uint32_t length = payload.size();
+	fwrite(&length, 4, 1, fp);
+	fwrite(payload.data(), 1, payload.size(), fp);
+}
+
+// Writes the vertices as a predicted vertex list (type 12), in the order the given triangles and quads first use them.
+// Those need to be exactly what a reader will have when it gets to this segment. Each run of up to (chunk) vertices goes
+// in a segment of its own, predicted only from the vertices in it, as a reader will.
+static void writePredictedVertices(FILE* fp, Mesh* mesh, Mesh* written, size_t chunk) {
+	size_t vertCount = mesh->v.size();
+	printf("Writing %u predicted vertices...", (uint32_t)vertCount);
+	fflush(stdout);
+	
+	for (size_t start = 0; start < vertCount; start += chunk) {
+		size_t n = min(chunk, vertCount - start);
+		vector<float> pos(n * 3);
+		vector<uint32_t> residuals;
+		residuals.reserve(n * 3);
+		predictVertices(written->t, written->q, start, n, pos.data(), [&](size_t v, const float* pred) {
+			memcpy(&pos[v*3], mesh->v[start + v]->c, 12);
+			for (int a = 0; a < 3; a++) {
+				uint32_t actual, guess;
+				memcpy(&actual, &pos[v*3 + a], 4);
+				memcpy(&guess, &pred[a], 4);
+				int32_t delta = floatOrder(actual) - floatOrder(guess);
+				residuals.push_back(((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+			}
+		});
+		
+		vector<uint8_t> payload(4);
+		uint32_t count = n;
+		memcpy(&payload[0], &count, 4);
+		encodeVarints(residuals, payload);
+		
+		uint8_t type = 12;
+		fwrite(&type, 1, 1, fp);
+		assert(payload.size() <= 0xFFFFFFFF);
+		uint32_t predLength = payload.size();
+		fwrite(&predLength, 4, 1, fp);
+		fwrite(payload.data(), 1, payload.size(), fp);
+	}
+	printf("Done.\n");
+}
+
+// Copies the segments in (from a scratch file) to out, wrapping the big ones in compressed segments where it helps.
+static void compressSegments(FILE* in, FILE* out, unsigned int threads) {
+	printf("Compressing segments...");
+	fflush(stdout);
+	auto start = chrono::steady_clock::now();
+	size_t before = 0, after = 0;
+	
+	fseek64(in, 0, SEEK_SET);
+	uint8_t type;
+	uint32_t length;
+	vector<uint8_t> raw, packed;
+	while (fread(&type, 1, 1, in) == 1) {
+		size_t ret = fread(&length, 4, 1, in);
+		assert(ret == 1);
+		raw.resize(length);
+		ret = fread(raw.data(), 1, length, in);
+		assert(ret == length);
+		
+		// Comments stay readable, and small segments aren't worth the header. Tiles and instances compress their own
+		// segments, and the tile directory has to stay where it is.
+		bool compressed = false;
+		if (type != 0 && type != 15 && type != 16 && type != 19 && length >= 4096) {
+			compressSegment(type, raw, packed, threads);
+			if (packed.size() < raw.size()) {
+				uint8_t wrapper = 11;
+				fwrite(&wrapper, 1, 1, out);
+				uint32_t packedLength = packed.size();
+				fwrite(&packedLength, 4, 1, out);
+				fwrite(packed.data(), 1, packed.size(), out);
+				after += 5 + packed.size();
+				compressed = true;
+			}
+		}
+		if (!compressed) {
+			fwrite(&type, 1, 1, out);
+			fwrite(&length, 4, 1, out);
+			fwrite(raw.data(), 1, raw.size(), out);
+			after += 5 + raw.size();
+		}
+		before += 5 + raw.size();
+	}
+	
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	printf("%llu -> %llu bytes (%.1f%%), %.0f MB/s.\n", (unsigned long long)before, (unsigned long long)after,
+		before ? 100.0 * after / before : 100.0, seconds > 0 ? before / seconds / 1e6 : 0.0);
+}
+
+// Lays out an index segment's payload: the entries, then the trailer.
+static void packIndex(const vector<IndexEntry>& index, vector<uint8_t>& payload) {
+	payload.resize(index.size() * SML_INDEX_ENTRY + 12);
+	for (size_t i = 0; i < index.size(); i++) {
+		uint8_t* p = &payload[i * SML_INDEX_ENTRY];
+		memcpy(p, &index[i].offset, 8);
+		memcpy(p + 8, &index[i].length, 4);
+		p[12] = index[i].type;
+		p[13] = index[i].inner;
+		memcpy(p + 14, &index[i].elements, 4);
+		memcpy(p + 18, &index[i].crc, 4);
+	}
+	uint8_t* trailer = &payload[index.size() * SML_INDEX_ENTRY];
+	uint32_t count = index.size();
+	uint32_t crc = crc32c(0, payload.data(), index.size() * SML_INDEX_ENTRY);
+	memcpy(trailer, &count, 4);
+	memcpy(trailer + 4, &crc, 4);
+	memcpy(trailer + 8, "SMLI", 4);
+}
+
+// Appends a segment index (type 14) listing every segment in the file, with what it holds and its CRC32C.
+static void writeIndex(FILE* fp, unsigned int threads) {
+	printf("Writing segment index...");
+	fflush(stdout);
+	fflush(fp);
+	fseek64(fp, 8, SEEK_SET);
+	vector<IndexEntry> index;
+	vector<vector<uint8_t>> payloads;
+	uint8_t type;
+	uint32_t length;
+	while (fread(&type, 1, 1, fp) == 1) {
+		size_t ret = fread(&length, 4, 1, fp);
+		assert(ret == 1);
+		IndexEntry entry;
+		entry.offset = ftell64(fp) - 5;
+		entry.length = length;
+		entry.type = type;
+		entry.inner = type;
+		index.push_back(entry);
+		payloads.emplace_back(length);
+		ret = fread(payloads.back().data(), 1, length, fp);
+		assert(ret == length);
+	}
+	
+	// Decoding each one is the simplest way to count what's in it; predicted vertices come out wrong without the
+	// triangles before them, but there are still the right number. Refinements can't be decoded alone at all, so
+	// they're counted by the splits in their header.
+	parallelFor(index.size(), threads, [&](size_t i) {
+		IndexEntry& entry = index[i];
+		entry.crc = crc32c(0, payloads[i].data(), payloads[i].size());
+		if (entry.type == 11) entry.inner = payloads[i][0];
+		if (entry.inner == 18) {
+			vector<uint8_t> raw;
+			uint8_t inner = 18;
+			if (entry.type == 11) decompressSegment(payloads[i], inner, raw, 1);
+			else raw.swap(payloads[i]);
+			memcpy(&entry.elements, raw.data(), 4);
+		} else {
+			Mesh part;
+			readSegment(&part, entry.type, payloads[i], 1);
+			// An instance segment can hold more than 32 bits will count, in which case this is as many as it can.
+			entry.elements = min(part.v.size() + part.t.size() + part.q.size(), (size_t)0xFFFFFFFF);
+		}
+		vector<uint8_t>().swap(payloads[i]);
+	});
+	
+	vector<uint8_t> payload;
+	packIndex(index, payload);
+	
+	fseek64(fp, 0, SEEK_END);
+	type = 14;
+	fwrite(&type, 1, 1, fp);
+	length = payload.size();
+	fwrite(&length, 4, 1, fp);
+	fwrite(payload.data(), 1, payload.size(), fp);
+	printf("%u segments.\n", (uint32_t)index.size());
+}
+
+// Writes the vertices, triangles and quads of a mesh as whichever segments the flags ask for.
+static void writeMeshSegments(FILE* fp, Mesh* mesh, uint32_t flags, const SMLOptions& options) {
+	// Edgebreaker renumbers the vertices it covers, then leaves the rest of the triangles to the usual segments.
+	vector<shared_ptr<Triangle>> allTriangles;
+	vector<uint8_t> edgebreaker;
+	if ((flags & SMLFlags::EDGEBREAKER) && !mesh->t.empty()) {
+		vector<uint32_t> order;
+		vector<shared_ptr<Triangle>> rest;
+		if (edgebreakerEncode(mesh, order, rest, edgebreaker)) {
+			if (edgebreaker.size() > 0xFFFFFFFF) {
+				// It all has to go in one segment, so past 4 GB the triangles go in the usual segments instead.
+				printf("Edgebreaker data is too big for one segment, leaving it out.\n");
+				edgebreaker.clear();
+			} else {
+				permuteVertices(mesh, order);
+				allTriangles.swap(mesh->t);
+				mesh->t.swap(rest);
+			}
+		}
+	}
+	// Fans take the triangles around vertices with lots of them before the strip search, which only gets two at a time.
+	vector<vector<uint32_t>> fans;
+	if ((flags & SMLFlags::FANS) && !mesh->t.empty()) {
+		vector<shared_ptr<Triangle>> rest;
+		fansearch(mesh, fans, rest, options.fanMin);
+		if (!fans.empty()) {
+			if (allTriangles.empty()) allTriangles.swap(mesh->t);
+			mesh->t.swap(rest);
+		}
+	}
+	if (flags & SMLFlags::STRIP_MAP) {
+		printf("Building spatial map...");
+		fflush(stdout);
+		mesh->spatialMap.build();
+		printf("Done.\n");
+	}
+	
+	uint8_t type;
+	// With an index, long lists are split up so a reader can check and decode the pieces in parallel. Without one they
+	// still are past SML_MAX_CHUNK, to fit the 32-bit segment lengths.
+	size_t chunk = SML_MAX_CHUNK;
+	if ((flags & SMLFlags::INDEX) && options.chunkSize) chunk = min(options.chunkSize, chunk);
+	
+	if (flags & SMLFlags::PREDICT_VERTICES) {
+		// These go after the triangles and quads, which are needed to decode them.
+	} else if (!mesh->v.empty() && (flags & SMLFlags::DOUBLE_VERTICES)) {
+		printf("Writing %u double-precision vertices...", (uint32_t)mesh->v.size());
+		fflush(stdout);
+		forChunks(mesh->v, chunk, [&](auto begin, auto end) {
+			writeDoubleVertices(fp, mesh, begin, end);
+		});
+		printf("Done.\n");
+	} else if (!mesh->v.empty() && (flags & SMLFlags::QUANTIZE_VERTICES)) {
+		writeQuantizedVertices(fp, mesh, options, chunk);
+	} else if (!mesh->v.empty() && !((flags & SMLFlags::GRID_VERTICES) && writeGridVertices(fp, mesh, chunk))) { // Hey, you never know...
+		printf("Writing %u vertices...", (uint32_t)mesh->v.size());
+		fflush(stdout);
+		forChunks(mesh->v, chunk, [&](auto begin, auto end) {
+			size_t vertCount = distance(begin, end);
+			assert(vertCount <= 357913941);
+			type = 1;
+			fwrite(&type, 1, 1, fp);
+			uint32_t vertLength = vertCount * 12;
+			fwrite(&vertLength, 4, 1, fp);
+			for (auto i = begin; i != end; ++i) {
+				(*i)->write(fp);
+			}
+		});
+		printf("Done.\n");
+	}
+	
+	
+	uint64_t connectivity = ftell64(fp);
+	// Quads take 16 bytes for two triangles against 24 in a plain triangle list, but lose to strips and varints, so
+	// with QUADS only the triangles that would go in a plain list are paired.
+	vector<shared_ptr<Quad>> quads(mesh->q);
+	bool pairing = (flags & SMLFlags::QUADS) && !(flags & SMLFlags::VARINT_INDICES);
+
+	if (!edgebreaker.empty()) {
+		printf("Writing Edgebreaker triangles...");
+		fflush(stdout);
+		type = 13;
+		fwrite(&type, 1, 1, fp);
+		uint32_t length = edgebreaker.size();
+		fwrite(&length, 4, 1, fp);
+		fwrite(edgebreaker.data(), 1, length, fp);
+		printf("Done.\n");
+	}
+	if (!fans.empty()) {
+		printf("Writing %u fans...", (uint32_t)fans.size());
+		fflush(stdout);
+		// Chunks are whole fans adding up to no more than (chunk) points, unless one fan is longer by itself.
+		for (auto begin = fans.begin(); begin != fans.end(); ) {
+			auto end = begin;
+			size_t points = 0;
+			while (end != fans.end() && (points == 0 || points + end->size() <= chunk)) {
+				points += end->size();
+				++end;
+			}
+			writeFans(fp, begin, end);
+			begin = end;
+		}
+		printf("Done.\n");
+	}
+	if (!mesh->t.empty()) {
+		if (flags & SMLFlags::STRIP) {
+			list<Triangle*> singles;
+			list<list<Triangle*>> strips;
+			
+			if (flags & SMLFlags::STRIP_MAP) {
+				stripsearch_map(mesh, singles, strips, options);
+			} else if (flags & SMLFlags::STRIP_NEXT) {
+				stripsearch_next(mesh, singles, strips, options);
+			} else if (flags & SMLFlags::STRIP_EXHAUSTIVE) {
+				stripsearch_exhaustive(mesh, singles, strips, options);
+			} else if (flags & SMLFlags::STRIP_LINK) {
+				stripsearch_link(mesh, singles, strips, options);
+			} else if (flags & SMLFlags::STRIP_GREEDY) {
+				stripsearch_greedy(mesh, singles, strips, options);
+			} else if (flags & SMLFlags::STRIP_PARALLEL) {
+				stripsearch_parallel(mesh, singles, strips, options);
+			}
+			
+			// The strip search goes its own way, so put the strips back in the order the mesh was sorted into, by the earliest
+			// triangle in each, and sort the leftovers for the cache among themselves.
+			if (flags & SMLFlags::REORDER_CACHE) {
+				unordered_map<Triangle*, uint32_t> rank;
+				rank.reserve(mesh->t.size());
+				for (uint32_t i = 0; i < mesh->t.size(); i++) rank[mesh->t[i].get()] = i;
+				vector<pair<uint32_t, list<Triangle*>>> sorted;
+				sorted.reserve(strips.size());
+				for (auto& strip : strips) {
+					uint32_t first = 0xFFFFFFFF;
+					for (Triangle* t : strip) first = min(first, rank[t]);
+					sorted.emplace_back(first, move(strip));
+				}
+				stable_sort(sorted.begin(), sorted.end(), [](const auto& x, const auto& y) { return x.first < y.first; });
+				strips.clear();
+				for (auto& s : sorted) strips.push_back(move(s.second));
+				
+				vector<Triangle*> tris(singles.begin(), singles.end());
+				vector<uint32_t> order;
+				cacheOrder(tris, mesh->v.size(), order);
+				singles.clear();
+				for (uint32_t i : order) singles.push_back(tris[i]);
+			}
+			
+			// Strips longer than a chunk are cut into pieces. Each strip triangle is what a reader has after its last index,
+			// so a piece can start from any of them, and starting from an even one keeps the alternation the same.
+			size_t piece = max<size_t>(chunk & ~(size_t)1, 2);
+			for (auto i = strips.begin(); i != strips.end(); ++i) {
+				while (i->size() > piece) {
+					list<Triangle*> head;
+					head.splice(head.end(), *i, i->begin(), next(i->begin(), piece));
+					strips.insert(i, move(head));
+				}
+			}
+			
+			if (flags & (SMLFlags::PACK_STRIPS | SMLFlags::VARINT_INDICES)) {
+				// Chunks here are whole strips adding up to no more than (chunk) triangles.
+				list<list<Triangle*>> group;
+				while (!strips.empty()) {
+					size_t tris = 0;
+					while (!strips.empty() && (tris == 0 || !chunk || tris + strips.front().size() <= chunk)) {
+						tris += strips.front().size();
+						group.splice(group.end(), strips, strips.begin());
+					}
+					writePackedStrips(fp, group, flags & SMLFlags::JOIN_STRIPS, flags & SMLFlags::VARINT_INDICES);
+					group.clear();
+				}
+			} else {
+				printf("Writing %u strips...", (unsigned int)strips.size());
+				fflush(stdout);
+				for (auto& strip : strips) {
+					type = 5;
+					fwrite(&type, 1, 1, fp);
+					
+					size_t striplen = strip.size();
+					uint32_t stripLength = (striplen+2) * sizeof(uint32_t);
+					fwrite(&stripLength, 4, 1, fp);
+
+					Triangle* first = strip.front();
+					strip.pop_front();
+					first->write(fp);
+					
+					for (auto& i : strip) {
+						fwrite(&(i->c), 4, 1, fp);
+					}
+				}
+				printf("Done.\n");
+			}
+			
+			if (pairing && !singles.empty()) {
+				vector<Triangle*> tris(singles.begin(), singles.end());
+				pairQuads(mesh, tris, quads);
+				singles.assign(tris.begin(), tris.end());
+			}
+			size_t triCount = singles.size();
+			if (triCount > 0) {
+				printf("Writing %u lone triangles...", (uint32_t)triCount);
+				fflush(stdout);
+				forChunks(singles, chunk, [&](auto begin, auto end) {
+					if (flags & SMLFlags::VARINT_INDICES) writeVarintTriangles(fp, begin, end);
+					else writeTriangles(fp, begin, end);
+				});
+				printf("Done.\n");
+			}
+		} else if (flags & SMLFlags::VARINT_INDICES) {
+			printf("Writing %u varint triangles...", (uint32_t)mesh->t.size());
+			fflush(stdout);
+			forChunks(mesh->t, chunk, [&](auto begin, auto end) {
+				writeVarintTriangles(fp, begin, end);
+			});
+			printf("Done.\n");
+		} else if (pairing) {
+			vector<Triangle*> tris;
+			tris.reserve(mesh->t.size());
+			for (auto& t : mesh->t) tris.push_back(t.get());
+			pairQuads(mesh, tris, quads);
+			if (!tris.empty()) {
+				printf("Writing %u triangles...", (uint32_t)tris.size());
+				fflush(stdout);
+				forChunks(tris, chunk, [&](auto begin, auto end) {
+					writeTriangles(fp, begin, end);
+				});
+				printf("Done.\n");
+			}
+		} else {
+			printf("Writing %u triangles...", (uint32_t)mesh->t.size());
+			fflush(stdout);
+			forChunks(mesh->t, chunk, [&](auto begin, auto end) {
+				writeTriangles(fp, begin, end);
+			});
+			printf("Done.\n");
+		}
+	}
+	
+	
+	if (!quads.empty()) {
+		printf("Writing %u quads...", (uint32_t)quads.size());
+		fflush(stdout);
+		forChunks(quads, chunk, [&](auto begin, auto end) {
+			size_t quadCount = distance(begin, end);
+			assert(quadCount <= 268435455);
+			type = 4;
+			fwrite(&type, 1, 1, fp);
+			uint32_t quadLength = quadCount * 16;
+			fwrite(&quadLength, 4, 1, fp);
+			for (auto i = begin; i != end; ++i) {
+				(*i)->write(fp);
+			}
+		});
+		printf("Done.\n");
+	}
+	
+	
+	if ((flags & SMLFlags::PREDICT_VERTICES) && !mesh->v.empty()) {
+		// Read back what was just written, to predict along the same triangles in the same order a reader will.
+		Mesh written;
+		fflush(fp);
+		fseek64(fp, connectivity, SEEK_SET);
+		uint32_t length;
+		vector<uint8_t> payload;
+		while (fread(&type, 1, 1, fp) == 1) {
+			size_t ret = fread(&length, 4, 1, fp);
+			assert(ret == 1);
+			payload.resize(length);
+			ret = fread(payload.data(), 1, length, fp);
+			assert(ret == length);
+			readSegment(&written, type, payload, options.threads);
+		}
+		fseek64(fp, 0, SEEK_END);
+		// Readers decode these in order anyway, so they're only split where they have to be.
+		writePredictedVertices(fp, mesh, &written, SML_MAX_CHUNK);
+	}
+	
+	if (!allTriangles.empty()) mesh->t.swap(allTriangles);
+}
+
+// Copies the given triangles and quads of a mesh into part, with the vertices they use numbered from part's start.
+// local has to be all 0xFFFFFFFF, one per vertex of mesh, and is left that way.
+static void extractPart(Mesh* mesh, const vector<uint32_t>& tris, const vector<uint32_t>& quads, Mesh& part, vector<uint32_t>& local) {
+	part.precise = mesh->precise;
+	auto localIndex = [&](uint32_t v) -> uint32_t {
+		if (local[v] == 0xFFFFFFFF) {
+			local[v] = part.v.size();
+			part.add(mesh->v[v]);
+		}
+		return local[v];
+	};
+	for (uint32_t i : tris) {
+		Triangle* t = mesh->t[i].get();
+		part.add(make_shared<Triangle>(localIndex(t->a), localIndex(t->b), localIndex(t->c)));
+	}
+	for (uint32_t i : quads) {
+		shared_ptr<Quad> q = make_shared<Quad>();
+		for (int k = 0; k < 4; k++) q->v[k] = localIndex(mesh->q[i]->v[k]);
+		part.add(q);
+	}
+	for (uint32_t i : tris) {
+		for (uint32_t v : mesh->t[i]->v) local[v] = 0xFFFFFFFF;
+	}
+	for (uint32_t i : quads) {
+		for (uint32_t v : mesh->q[i]->v) local[v] = 0xFFFFFFFF;
+	}
+}
+
+// Writes a part's segments as they go inside a tile or instance segment, compressed if the flags say so.
+static void writeNested(Mesh* part, uint32_t flags, const SMLOptions& options, vector<uint8_t>& data) {
+	FILE* inner = tmpfile();
+	if (!inner) {
+		fprintf(stderr, "Could not create a temporary file: %s\n", strerror(errno));
+		exit(__LINE__);
+	}
+	writeMeshSegments(inner, part, flags, options);
+	if (flags & SMLFlags::COMPRESS) {
+		FILE* packed = tmpfile();
+		if (!packed) {
+			fprintf(stderr, "Could not create a temporary file: %s\n", strerror(errno));
+			exit(__LINE__);
+		}
+		compressSegments(inner, packed, options.threads);
+		fclose(inner);
+		inner = packed;
+	}
+	fflush(inner);
+	data.resize(ftell64(inner));
+	fseek64(inner, 0, SEEK_SET);
+	size_t ret = fread(data.data(), 1, data.size(), inner);
+	assert(ret == data.size());
+	fclose(inner);
+}
+
+#define SML_TILE_ENTRY 48
+
+// Writes the mesh as tiles (type 16), each holding the segments for the triangles and quads whose centres fall in one
+// cell of a grid over the bounding box, after a directory (type 15) saying where each tile is and what it covers.
+// Vertices used by more than one tile are stored in each of them, so tiles can be read on their own.
+static void writeTiles(FILE* fp, Mesh* mesh, uint32_t flags, const SMLOptions& options) {
+	if (mesh->minX > mesh->maxX) mesh->updateBounds();
+	float lo[3] = { mesh->minX, mesh->minY, mesh->minZ };
+	float hi[3] = { mesh->maxX, mesh->maxY, mesh->maxZ };
+	unsigned int cells = options.tiles[0] * options.tiles[1] * options.tiles[2];
+	assert(cells >= 1);
+	auto cellOf = [&](const uint32_t* v, int sides) -> unsigned int {
+		unsigned int cell = 0;
+		for (int a = 2; a >= 0; a--) {
+			float centre = 0;
+			for (int i = 0; i < sides; i++) centre += mesh->v[v[i]]->c[a];
+			centre /= sides;
+			int n = options.tiles[a];
+			int k = hi[a] > lo[a] ? (int)((centre - lo[a]) / (hi[a] - lo[a]) * n) : 0;
+			cell = cell * n + min(max(k, 0), n - 1);
+		}
+		return cell;
+	};
+	vector<vector<uint32_t>> tris(cells), quads(cells);
+	for (size_t i = 0; i < mesh->t.size(); i++) {
+		tris[cellOf(mesh->t[i]->v, 3)].push_back(i);
+	}
+	for (size_t i = 0; i < mesh->q.size(); i++) {
+		quads[cellOf(mesh->q[i]->v, 4)].push_back(i);
+	}
+	uint32_t count = 0;
+	for (unsigned int c = 0; c < cells; c++) {
+		if (!tris[c].empty() || !quads[c].empty()) count++;
+	}
 	
-	#ifdef _WIN32
-		printf("Reading %ls...\n", file.c_str());
-		fflush(stdout);
-		FILE* fp = _wfopen(file.c_str(), L"rb");
-		if (!fp) {
-			fprintf(stderr, "Could not open SML file '%ls' for reading: %s\n", file.c_str(), strerror(errno));
+	// The directory goes first so a reader can find it without reading past it; it's filled in once the tiles are written.
+	uint8_t type = 15;
+	fwrite(&type, 1, 1, fp);
+	vector<uint8_t> directory(4 + (size_t)count * SML_TILE_ENTRY, 0);
+	memcpy(&directory[0], &count, 4);
+	uint32_t length = directory.size();
+	fwrite(&length, 4, 1, fp);
+	uint64_t directoryStart = ftell64(fp);
+	fwrite(directory.data(), 1, directory.size(), fp);
+	uint64_t directoryEnd = ftell64(fp);
+	
+	vector<uint32_t> local(mesh->v.size(), 0xFFFFFFFF);
+	vector<uint8_t> data;
+	uint32_t tile = 0;
+	for (unsigned int c = 0; c < cells; c++) {
+		if (tris[c].empty() && quads[c].empty()) continue;
+		printf("Tile %u of %u, %u triangles, %u quads:\n", tile + 1, count, (uint32_t)tris[c].size(), (uint32_t)quads[c].size());
+		
+		Mesh part;
+		extractPart(mesh, tris[c], quads[c], part, local);
+		writeNested(&part, flags, options, data);
+		
+		float bounds[6] = { part.minX, part.minY, part.minZ, part.maxX, part.maxY, part.maxZ };
+		if (data.size() + 24 > 0xFFFFFFFF) {
+			fprintf(stderr, "Error: Tile %u is too big for one segment, try more tiles.\n", tile + 1);
 			exit(__LINE__);
 		}
-	#else
-		printf("Reading %s...\n", file.c_str());
-		fflush(stdout);
-		FILE* fp = fopen(file.c_str(), "r");
-		if (!fp) {
-			fprintf(stderr, "Could not open SML file '%s' for reading: %m\n", file.c_str());
+		uint64_t offset = ftell64(fp) - directoryEnd;
+		type = 16;
+		fwrite(&type, 1, 1, fp);
+		length = data.size() + 24;
+		fwrite(&length, 4, 1, fp);
+		fwrite(bounds, 4, 6, fp);
+		fwrite(data.data(), 1, data.size(), fp);
+		
+		uint8_t* entry = &directory[4 + (size_t)tile * SML_TILE_ENTRY];
+		uint32_t elements[3] = { (uint32_t)part.v.size(), (uint32_t)part.t.size(), (uint32_t)part.q.size() };
+		memcpy(entry, bounds, 24);
+		memcpy(entry + 24, &offset, 8);
+		memcpy(entry + 32, &length, 4);
+		memcpy(entry + 36, elements, 12);
+		tile++;
+	}
+	
+	fseek64(fp, directoryStart, SEEK_SET);
+	fwrite(directory.data(), 1, directory.size(), fp);
+	fseek64(fp, 0, SEEK_END);
+}
+
+// Writes each shape that turns up more than once as an instance segment (type 19), holding it once along with the
+// offsets of its other copies, after the segments for everything else.
+static void writeInstances(FILE* fp, Mesh* mesh, uint32_t flags, const SMLOptions& options) {
+	vector<InstanceGroup> groups;
+	vector<uint8_t> instanced;
+	findInstances(mesh, groups, instanced);
+	if (groups.empty()) {
+		writeMeshSegments(fp, mesh, flags, options);
+		return;
+	}
+	
+	vector<uint32_t> local(mesh->v.size(), 0xFFFFFFFF);
+	vector<uint32_t> tris, quads;
+	for (uint32_t i = 0; i < mesh->t.size(); i++) {
+		if (!instanced[i]) tris.push_back(i);
+	}
+	for (uint32_t i = 0; i < mesh->q.size(); i++) quads.push_back(i);
+	if (!tris.empty() || !quads.empty()) {
+		Mesh rest;
+		extractPart(mesh, tris, quads, rest, local);
+		printf("Writing the rest, %u triangles and %u quads:\n", (uint32_t)rest.t.size(), (uint32_t)rest.q.size());
+		writeMeshSegments(fp, &rest, flags, options);
+	}
+	
+	vector<uint8_t> data;
+	for (size_t g = 0; g < groups.size(); g++) {
+		InstanceGroup& group = groups[g];
+		Mesh shape;
+		extractPart(mesh, group.triangles, vector<uint32_t>(), shape, local);
+		printf("Shape %u of %u, %u triangles, %u copies:\n", (uint32_t)g + 1, (uint32_t)groups.size(),
+			(uint32_t)shape.t.size(), (uint32_t)group.offsets.size() + 1);
+		writeNested(&shape, flags, options, data);
+		
+		uint32_t count = group.offsets.size();
+		if (4 + (size_t)count * 12 + data.size() > 0xFFFFFFFF) {
+			fprintf(stderr, "Error: Shape %u is too big for one instance segment.\n", (uint32_t)g + 1);
 			exit(__LINE__);
 		}
-	#endif
+		uint8_t type = 19;
+		fwrite(&type, 1, 1, fp);
+		uint32_t length = 4 + count * 12 + data.size();
+		fwrite(&length, 4, 1, fp);
+		fwrite(&count, 4, 1, fp);
+		for (Vertex& offset : group.offsets) offset.write(fp);
+		fwrite(data.data(), 1, data.size(), fp);
+	}
+}
+
+// Writes the mesh decimated down to 1/2^levels of its triangles, then the refinements (type 18) that take it back to the
+// full mesh, each doubling the triangle count. A reader can stop after any of them and have a whole mesh.
+static void writeLevels(FILE* fp, Mesh* mesh, uint32_t flags, const SMLOptions& options) {
+	size_t triCount = mesh->t.size();
+	if (triCount > 0xFFFFFFFF) {
+		fprintf(stderr, "Error: Refinements number triangles in 32 bits, which can't count %llu of them.\n", (unsigned long long)triCount);
+		exit(__LINE__);
+	}
+	size_t target = max(triCount >> options.lodLevels, (size_t)1);
+	vector<Triangle> tris;
+	vector<uint8_t> alive;
+	vector<EdgeCollapse> collapses;
+	decimate(mesh, target, tris, alive, collapses);
 	
-	char magic[4];
-	size_t ret = fread(magic, 1, 4, fp);
-	assert(ret == 4);
-	assert(!memcmp(magic, "SML1", 4));
+	vector<uint8_t> removed(mesh->v.size(), 0);
+	for (auto& c : collapses) removed[c.u] = 1;
+	Mesh base;
+	base.precise = mesh->precise;
+	vector<uint32_t> baseIndex(mesh->v.size(), 0xFFFFFFFF);
+	for (size_t i = 0; i < mesh->v.size(); i++) {
+		if (removed[i]) continue;
+		baseIndex[i] = base.v.size();
+		base.add(mesh->v[i]);
+	}
+	for (size_t i = 0; i < triCount; i++) {
+		if (alive[i]) base.add(make_shared<Triangle>(baseIndex[tris[i].a], baseIndex[tris[i].b], baseIndex[tris[i].c]));
+	}
+	for (auto& q : mesh->q) {
+		shared_ptr<Quad> quad = make_shared<Quad>();
+		for (int k = 0; k < 4; k++) quad->v[k] = baseIndex[q->v[k]];
+		base.add(quad);
+	}
 	
-	uint32_t crc;
-	ret = fread(&crc, 4, 1, fp);
-	assert(ret == 1);
+	printf("Writing base mesh, %u of %u triangles:\n", (uint32_t)base.t.size(), (uint32_t)triCount);
+	fflush(fp);
+	uint64_t start = ftell64(fp);
+	writeMeshSegments(fp, &base, flags, options);
 	
-	// Check CRC
+	// Strips and the rest put triangles in their own order, and refinements need to know where each one ended up, so
+	// read back what was written.
+	Mesh written;
+	fflush(fp);
+	fseek64(fp, start, SEEK_SET);
+	uint8_t type;
+	uint32_t length;
+	vector<uint8_t> payload;
+	while (fread(&type, 1, 1, fp) == 1) {
+		size_t ret = fread(&length, 4, 1, fp);
+		assert(ret == 1);
+		payload.resize(length);
+		ret = fread(payload.data(), 1, length, fp);
+		assert(ret == length);
+		readSegment(&written, type, payload, options.threads);
+	}
+	fseek64(fp, 0, SEEK_END);
+	
+	// Final vertex numbers: the base's as written (Edgebreaker may have moved them), then the rest as they're split off.
+	vector<uint32_t> final(mesh->v.size(), 0xFFFFFFFF);
 	{
-		printf("Computing CRC32C...");
+		unordered_map<Vertex*, uint32_t> position;
+		for (uint32_t i = 0; i < base.v.size(); i++) position[base.v[i].get()] = i;
+		for (size_t i = 0; i < mesh->v.size(); i++) {
+			if (!removed[i]) final[i] = position[mesh->v[i].get()];
+		}
+	}
+	// Triangles are matched up by their corners, rotated to the lowest order so the starting corner doesn't matter.
+	auto key = [](uint32_t a, uint32_t b, uint32_t c) {
+		return min(min(make_tuple(a, b, c), make_tuple(b, c, a)), make_tuple(c, a, b));
+	};
+	map<tuple<uint32_t, uint32_t, uint32_t>, vector<uint32_t>> where;
+	for (uint32_t i = 0; i < written.t.size(); i++) {
+		Triangle* t = written.t[i].get();
+		where[key(t->a, t->b, t->c)].push_back(i);
+	}
+	vector<uint32_t> id(triCount, 0xFFFFFFFF);
+	for (size_t i = 0; i < triCount; i++) {
+		if (!alive[i]) continue;
+		auto& list = where[key(final[tris[i].a], final[tris[i].b], final[tris[i].c])];
+		assert(!list.empty());
+		id[i] = list.back();
+		list.pop_back();
+	}
+	
+	uint32_t nextVertex = base.v.size();
+	uint32_t nextTriangle = written.t.size();
+	size_t threshold = max((size_t)nextTriangle * 2, (size_t)1);
+	vector<float> positions;
+	vector<uint32_t> values;
+	int level = 0;
+	auto flush = [&]() {
+		uint32_t splits = positions.size() / 3;
+		printf("Writing refinement %d, %u vertices, up to %u triangles...", ++level, splits, nextTriangle);
 		fflush(stdout);
-		size_t len;
-		char* buffer = (char*)malloc(1*1024*1024);
-		uint32_t crc2 = 0;
-		while ((len = fread(buffer, 1, (1*1024*1024), fp)) > 0) {
-			crc2 = crc32c(crc2, buffer, len);
+		vector<uint8_t> data(8);
+		uint32_t count = values.size();
+		memcpy(&data[0], &splits, 4);
+		memcpy(&data[4], &count, 4);
+		data.insert(data.end(), (uint8_t*)positions.data(), (uint8_t*)(positions.data() + positions.size()));
+		encodeVarints(values, data);
+		assert(data.size() <= 0xFFFFFFFF);
+		uint8_t type = 18;
+		fwrite(&type, 1, 1, fp);
+		uint32_t length = data.size();
+		fwrite(&length, 4, 1, fp);
+		fwrite(data.data(), 1, data.size(), fp);
+		positions.clear();
+		values.clear();
+		printf("Done.\n");
+	};
+	for (size_t i = collapses.size(); i-- > 0; ) {
+		EdgeCollapse& c = collapses[i];
+		final[c.u] = nextVertex++;
+		positions.insert(positions.end(), mesh->v[c.u]->c, mesh->v[c.u]->c + 3);
+		values.push_back(final[c.v]);
+		values.push_back(c.changed.size());
+		for (uint32_t t : c.changed) values.push_back(id[t]);
+		values.push_back(c.removed.size());
+		for (uint32_t t : c.removed) {
+			id[t] = nextTriangle++;
+			for (uint32_t w : tris[t].v) values.push_back(final[w]);
+		}
+		// A last few stragglers go in with the level before rather than making one of their own.
+		if (nextTriangle >= threshold && (triCount - nextTriangle) * 16 >= nextTriangle) {
+			flush();
+			threshold *= 2;
+		} else if (values.size() >= SML_MAX_CHUNK) {
+			// Too big for one segment, so the level carries on in another refinement.
+			flush();
 		}
-		free(buffer);
-		printf("read %08x, calculated %08x\n", crc, crc2);
-		assert(crc == crc2);
-		
-		fseek(fp, 8, SEEK_SET);
 	}
+	if (!positions.empty()) flush();
+}
 
+#define SML_STATS_LENGTH 77
 
-	#ifdef _MSC_VER
-	#pragma pack(push, 1)
-	struct {
-		uint8_t type;
-		uint32_t length;
-	} header;
-	#pragma pack(pop)
-	#else
-	struct __attribute__((packed)) {
-		uint8_t type;
-		uint32_t length;
-	} header;
-	#endif
-	while (fread(&header, 5, 1, fp) == 1) {
-		//printf("Reading segment, type %hhu, length %u...", header.type, header.length);
-		//fflush(stdout);
-		
-		switch (header.type) {
-			case 0: {
-				char* buffer = (char*)malloc(header.length+1);
-				fread(buffer, 1, header.length, fp);
-				mesh->comments.emplace_back(buffer);
-				free(buffer);
-			} break;
-			
-			case 1: { // Vertex float list
-				int verts = header.length / 12;
-				for (int i = 0; i < verts; i++) {
-					shared_ptr<Vertex> v = make_shared<Vertex>();
-					v->read(fp);
-					mesh->v.push_back(v);
-				}
-			} break;
-			
-			case 2: { // Vertex double list; here we're just dumping the extra precision and converting to floats.
-				int verts = header.length / 24;
-				for (int i = 0; i < verts; i++) {
-					shared_ptr<Vertex> v = make_shared<Vertex>();
-					v->read(fp);
-					mesh->v.push_back(v);
-				}				
-			} break;
-			
-			case 3: { // Triangle list
-				int tris = header.length / 12;
-				for (int i = 0; i < tris; i++) {
-					shared_ptr<Triangle> t = make_shared<Triangle>();
-					t->read(fp);
-					mesh->t.push_back(t);
-				}
-			} break;
-			
-			case 4: { // Quad list
-				int quads = header.length / 16;
-				for (int i = 0; i < quads; i++) {
-					shared_ptr<Quad> q = make_shared<Quad>();
-					q->read(fp);
-					mesh->q.push_back(q);
-				}
-			} break;
-			
-			case 5: { // Triangle strip
-				int points = header.length / 4;
-				assert(points >= 3);
-				
-				uint32_t verts[3];
-				
-				fread(verts, 4, 3, fp);
-				mesh->t.push_back(make_shared<Triangle>(verts));
-				//printf("\nStrip: %u,%u,%u\n", verts[0], verts[1], verts[2]);
-				
-				for (int i = 3; i < points; i++) {
-					/* i=0  0 1 2
-					   i=3  0 2 3	2->1
-					   i=4  3 2 4	2->0 */
-					verts[i & 1] = verts[2];
-					ret = fread(&verts[2], 4, 1, fp);
-					assert(ret == 1);
-					
-					//printf("\t%u,%u,%u\n", verts[0], verts[1], verts[2]);
-					mesh->t.push_back(make_shared<Triangle>(verts));
-				}
-			} break;
-			
-			default:
-				fprintf(stderr, "Error: Unrecognized segment type '%hhu'\n", header.type);
-				exit(__LINE__);
+// Adds up area, volume and the content hash across (threads) threads. The hash of each triangle is taken over its
+// vertex coordinates rotated to whichever start compares lowest, and the hashes are summed, so neither the order of the
+// faces nor which corner each one starts at changes it. Quads count as their two triangles, so pairing triangles into
+// quads doesn't change it either.
+static void computeStats(Mesh* mesh, SMLStats& stats, unsigned int threads) {
+	if (mesh->minX > mesh->maxX) mesh->updateBounds();
+	stats.min[0] = mesh->minX; stats.min[1] = mesh->minY; stats.min[2] = mesh->minZ;
+	stats.max[0] = mesh->maxX; stats.max[1] = mesh->maxY; stats.max[2] = mesh->maxZ;
+	stats.vertices = mesh->v.size();
+	stats.triangles = mesh->t.size();
+	stats.quads = mesh->q.size();
+	
+	auto faceHash = [&](uint32_t a, uint32_t b, uint32_t c) -> uint64_t {
+		uint32_t v[3] = { a, b, c };
+		float coords[9], rotated[9];
+		for (int i = 0; i < 3; i++) {
+			memcpy(&coords[i*3], mesh->v[v[i]]->c, 12);
 		}
-		//printf("Done.\n");
+		for (int first = 1; first < 3; first++) {
+			for (int i = 0; i < 3; i++) {
+				memcpy(&rotated[i*3], mesh->v[v[(first + i) % 3]]->c, 12);
+			}
+			if (memcmp(rotated, coords, 36) < 0) memcpy(coords, rotated, 36);
+		}
+		uint32_t lo = crc32c(0, coords, 36);
+		uint32_t hi = crc32c(lo, coords, 36);
+		return ((uint64_t)hi << 32) | lo;
+	};
+	auto addTriangle = [&](uint32_t a, uint32_t b, uint32_t c, double& area, double& volume) {
+		const float* p = mesh->v[a]->c;
+		const float* q = mesh->v[b]->c;
+		const float* r = mesh->v[c]->c;
+		double u[3] = { (double)q[0] - p[0], (double)q[1] - p[1], (double)q[2] - p[2] };
+		double w[3] = { (double)r[0] - p[0], (double)r[1] - p[1], (double)r[2] - p[2] };
+		double n[3] = { u[1]*w[2] - u[2]*w[1], u[2]*w[0] - u[0]*w[2], u[0]*w[1] - u[1]*w[0] };
+		area += sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]) / 2;
+		volume += ((double)p[0] * ((double)q[1]*r[2] - (double)q[2]*r[1])
+			- (double)p[1] * ((double)q[0]*r[2] - (double)q[2]*r[0])
+			+ (double)p[2] * ((double)q[0]*r[1] - (double)q[1]*r[0])) / 6;
+	};
+	
+	size_t faces = mesh->t.size() + mesh->q.size();
+	size_t blocks = max((size_t)1, min((size_t)threads, faces / 65536));
+	vector<double> area(blocks, 0), volume(blocks, 0);
+	vector<uint64_t> hash(blocks, 0);
+	parallelFor(blocks, threads, [&](size_t b) {
+		for (size_t i = faces * b / blocks; i < faces * (b + 1) / blocks; i++) {
+			if (i < mesh->t.size()) {
+				Triangle* t = mesh->t[i].get();
+				addTriangle(t->a, t->b, t->c, area[b], volume[b]);
+				hash[b] += faceHash(t->a, t->b, t->c);
+			} else {
+				Quad* q = mesh->q[i - mesh->t.size()].get();
+				addTriangle(q->a, q->b, q->c, area[b], volume[b]);
+				addTriangle(q->a, q->c, q->d, area[b], volume[b]);
+				hash[b] += faceHash(q->a, q->b, q->c) + faceHash(q->a, q->c, q->d);
+			}
+		}
+	});
+	stats.area = stats.volume = 0;
+	stats.hash = 0;
+	for (size_t b = 0; b < blocks; b++) {
+		stats.area += area[b];
+		stats.volume += volume[b];
+		stats.hash += hash[b];
 	}
-	printf("Done.\n");
-	return mesh;
 }
 
+static void writeStats(FILE* fp, const SMLStats& stats) {
+	uint8_t payload[SML_STATS_LENGTH];
+	memcpy(payload, stats.min, 12);
+	memcpy(payload + 12, stats.max, 12);
+	memcpy(payload + 24, &stats.vertices, 8);
+	memcpy(payload + 32, &stats.triangles, 8);
+	memcpy(payload + 40, &stats.quads, 8);
+	memcpy(payload + 48, &stats.area, 8);
+	memcpy(payload + 56, &stats.volume, 8);
+	memcpy(payload + 64, &stats.hash, 8);
+	payload[72] = stats.lossy ? 1 : 0;
+	uint32_t crc = crc32c(0, payload, 73);
+	memcpy(payload + 73, &crc, 4);
+	
+	uint8_t type = 17;
+	fwrite(&type, 1, 1, fp);
+	uint32_t length = SML_STATS_LENGTH;
+	fwrite(&length, 4, 1, fp);
+	fwrite(payload, 1, SML_STATS_LENGTH, fp);
+}
 
+bool readSMLStats(filesystem::path file, SMLStats& stats) {
+	FILE* fp = openSML(file);
+	uint8_t buffer[8 + 5 + SML_STATS_LENGTH];
+	fseek64(fp, 0, SEEK_SET);
+	size_t ret = fread(buffer, 1, sizeof(buffer), fp);
+	fclose(fp);
+	uint32_t length;
+	memcpy(&length, buffer + 9, 4);
+	if (ret != sizeof(buffer) || buffer[8] != 17 || length != SML_STATS_LENGTH) return false;
+	
+	const uint8_t* payload = buffer + 13;
+	uint32_t crc;
+	memcpy(&crc, payload + 73, 4);
+	if (crc32c(0, payload, 73) != crc) return false;
+	memcpy(stats.min, payload, 12);
+	memcpy(stats.max, payload + 12, 12);
+	memcpy(&stats.vertices, payload + 24, 8);
+	memcpy(&stats.triangles, payload + 32, 8);
+	memcpy(&stats.quads, payload + 40, 8);
+	memcpy(&stats.area, payload + 48, 8);
+	memcpy(&stats.volume, payload + 56, 8);
+	memcpy(&stats.hash, payload + 64, 8);
+	stats.lossy = payload[72] & 1;
+	return true;
+}
 
-void writeSML(filesystem::path file, Mesh* mesh, uint32_t flags) {
-	if (flags & SMLFlags::STRIP_MAP) {
-		printf("Building spatial map...");
-		fflush(stdout);
-		mesh->spatialMap.build();
-		printf("Done.\n");
+void writeSML(filesystem::path file, Mesh* mesh, uint32_t flags, const SMLOptions& options) {
+	if (mesh->v.size() > SML_MAX_VERTICES) {
+		fprintf(stderr, "Error: More than %llu vertices, which 32-bit indices can't reach.\n", SML_MAX_VERTICES);
+		exit(__LINE__);
+	}
+	// Doubles are kept exactly as they are, so they take the place of the other ways of storing vertices.
+	if (flags & SMLFlags::DOUBLE_VERTICES) {
+		flags &= ~(SMLFlags::GRID_VERTICES | SMLFlags::QUANTIZE_VERTICES | SMLFlags::PREDICT_VERTICES);
+	}
+	// Quantized vertices that miss the error asked for are no use, so they're written losslessly instead, the same as
+	// --grid does when there's no grid.
+	if ((flags & SMLFlags::QUANTIZE_VERTICES) && !mesh->v.empty()) {
+		double error;
+		if (!quantizeBits(mesh, options, error)) {
+			printf("Quantizing can only get within %g with 16 bits, not %g. Writing lossless vertices instead.\n", error,
+				options.quantizeError);
+			flags &= ~SMLFlags::QUANTIZE_VERTICES;
+		}
+	}
+	if (flags & SMLFlags::REORDER_CACHE) {
+		// 16 entries is about the smallest cache a GPU has; the order is made for 32, and does well with both.
+		double acmr[2], atvr[2];
+		measureVertexCache(mesh, 16, acmr[0], atvr[0]);
+		optimizeVertexCache(mesh);
+		renumberVertices(mesh);
+		measureVertexCache(mesh, 16, acmr[1], atvr[1]);
+		printf("Vertex cache misses: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f.\n", acmr[0], acmr[1], atvr[0], atvr[1]);
+	} else if (flags & SMLFlags::REORDER) {
+		reorderTriangles(mesh, flags & SMLFlags::REORDER_HILBERT, options.threads);
+		renumberVertices(mesh);
 	}
 	
 	#ifdef _WIN32
@@ -179,10 +2539,30 @@ void writeSML(filesystem::path file, Mesh* mesh, uint32_t flags) {
 	
 	fwrite("SML1", 4, 1, fp); // Identifying header
 	// Skip CRC until the end.
-	fseek(fp, 8, SEEK_SET);
+	fseek64(fp, 8, SEEK_SET);
+	
+	// Compression needs each segment whole, so write them to a scratch file first and compress it into the real one.
+	FILE* out = fp;
+	if (flags & SMLFlags::COMPRESS) {
+		fp = tmpfile();
+		if (!fp) {
+			fprintf(stderr, "Could not create a temporary file: %s\n", strerror(errno));
+			exit(__LINE__);
+		}
+	}
 	
 	uint8_t type;
 	
+	{
+		printf("Computing stats...");
+		fflush(stdout);
+		SMLStats stats;
+		computeStats(mesh, stats, options.threads);
+		stats.lossy = flags & SMLFlags::QUANTIZE_VERTICES;
+		writeStats(fp, stats);
+		printf("area %g, volume %g, hash %016llx.\n", stats.area, stats.volume, (unsigned long long)stats.hash);
+	}
+	
 	if (!mesh->comments.empty()) {
 		printf("Writing %u comment%s...", (uint32_t)mesh->comments.size(), mesh->comments.size() == 1 ? "" : "s");
 		fflush(stdout);
@@ -197,111 +2577,31 @@ void writeSML(filesystem::path file, Mesh* mesh, uint32_t flags) {
 	}
 
 	
-	if (!mesh->v.empty()) { // Hey, you never know...
-		size_t vertCount = mesh->v.size();
-		assert(vertCount <= 357913941);
-		printf("Writing %u vertices...", (uint32_t)vertCount);
-		fflush(stdout);
-		type = 1;
-		fwrite(&type, 1, 1, fp);
-		uint32_t vertLength = vertCount * 12;
-		fwrite(&vertLength, 4, 1, fp);
-		for (auto& i : mesh->v) {
-			i->write(fp);
-		}
-		printf("Done.\n");
+	if (flags & SMLFlags::LEVELS) {
+		writeLevels(fp, mesh, flags, options);
+	} else if (flags & SMLFlags::TILES) {
+		writeTiles(fp, mesh, flags, options);
+	} else if (flags & SMLFlags::INSTANCES) {
+		writeInstances(fp, mesh, flags, options);
+	} else {
+		writeMeshSegments(fp, mesh, flags, options);
 	}
 	
 	
-	if (!mesh->t.empty()) {
-		if (flags & SMLFlags::STRIP) {
-			list<Triangle*> singles;
-			list<list<Triangle*>> strips;
-			
-			if (flags & SMLFlags::STRIP_MAP) {
-				stripsearch_map(mesh, singles, strips);
-			} else if (flags & SMLFlags::STRIP_NEXT) {
-				stripsearch_next(mesh, singles, strips);
-			} else if (flags & SMLFlags::STRIP_EXHAUSTIVE) {
-				stripsearch_exhaustive(mesh, singles, strips);
-			} else if (flags & SMLFlags::STRIP_LINK) {
-				stripsearch_link(mesh, singles, strips);
-			}
-			
-			printf("Writing %u strips...", (unsigned int)strips.size());
-			fflush(stdout);
-			for (auto& strip : strips) {
-				type = 5;
-				fwrite(&type, 1, 1, fp);
-				
-				size_t striplen = strip.size();
-				assert(striplen <= 1073741821);
-				uint32_t stripLength = (striplen+2) * sizeof(uint32_t);
-				fwrite(&stripLength, 4, 1, fp);
-
-				Triangle* first = strip.front();
-				strip.pop_front();
-				first->write(fp);
-				
-				for (auto& i : strip) {
-					fwrite(&(i->c), 4, 1, fp);
-				}
-			}
-			printf("Done.\n");
-			
-			size_t triCount = singles.size();
-			assert(triCount <= 357913941);
-			if (triCount > 0) {
-				printf("Writing %u lone triangles...", (uint32_t)triCount);
-				fflush(stdout);
-				type = 3;
-				fwrite(&type, 1, 1, fp);
-				uint32_t triLength = triCount * 12;
-				fwrite(&triLength, 4, 1, fp);
-				for (auto& i : singles) {
-					i->write(fp);
-				}
-				printf("Done.\n");
-			}
-		} else {
-			type = 3;
-			fwrite(&type, 1, 1, fp);
-			
-			size_t triCount = mesh->t.size();
-			assert(triCount <= 357913941);
-			printf("Writing %u triangles...", (uint32_t)triCount);
-			fflush(stdout);
-			uint32_t triLength = triCount * 12;
-			fwrite(&triLength, 4, 1, fp);
-			for (auto& i : mesh->t) {
-				i->write(fp);
-			}
-			printf("Done.\n");
-		}
+	if (fp != out) {
+		compressSegments(fp, out, options.threads);
+		fclose(fp);
+		fp = out;
 	}
-	
-	
-	if (!mesh->q.empty()) {
-		type = 4;
-		fwrite(&type, 1, 1, fp);
-		
-		size_t quadCount = mesh->q.size();
-		assert(quadCount <= 268435455);
-		printf("Writing %u quads...", (uint32_t)quadCount);
-		fflush(stdout);
-		uint32_t quadLength = quadCount * 16;
-		fwrite(&quadLength, 4, 1, fp);
-		for (auto& i : mesh->q) {
-			i->write(fp);
-		}
-		printf("Done.\n");
+	if (flags & SMLFlags::INDEX) {
+		writeIndex(fp, options.threads);
 	}
 	
 	
 	// Write CRC
 	printf("Computing CRC32C...");
 	fflush(stdout);
-	fseek(fp, 8, SEEK_SET);
+	fseek64(fp, 8, SEEK_SET);
 	size_t len;
 	char* buffer = (char*)malloc(1*1024*1024);
 	uint32_t crc = 0;
@@ -309,10 +2609,271 @@ void writeSML(filesystem::path file, Mesh* mesh, uint32_t flags) {
 		crc = crc32c(crc, buffer, len);
 	}
 	free(buffer);
-	fseek(fp, 4, SEEK_SET);
+	fseek64(fp, 4, SEEK_SET);
 	fwrite(&crc, 4, 1, fp);
 	printf("%08x\n", crc);
 	fclose(fp);
 	
 	printf("File written.\n");
+}
+
+Mesh* readSMLRegion(std::filesystem::path file, const float lo[3], const float hi[3]) {
+	FILE* fp = openSML(file);
+	Mesh* mesh = new Mesh();
+	
+	// The whole-file CRC would mean reading the whole file; the index has one for each tile, if it's there.
+	vector<IndexEntry> index;
+	bool indexed = readIndex(fp, index);
+	fseek64(fp, 8, SEEK_SET);
+	
+	// Comments (and stats) come before the tile directory, so they're all read on the way.
+	uint8_t type;
+	uint32_t length;
+	vector<uint8_t> directory;
+	while (fread(&type, 1, 1, fp) == 1 && fread(&length, 4, 1, fp) == 1) {
+		if (type == 17) {
+			fseek64(fp, length, SEEK_CUR);
+		} else if (type == 0) {
+			vector<uint8_t> comment(length);
+			size_t ret = fread(comment.data(), 1, length, fp);
+			assert(ret == length);
+			readSegment(mesh, type, comment, 1);
+		} else if (type == 15) {
+			directory.resize(length);
+			size_t ret = fread(directory.data(), 1, length, fp);
+			assert(ret == length);
+			break;
+		} else {
+			break;
+		}
+	}
+	if (directory.empty()) {
+		printf("No tile directory, reading the whole file.\n");
+		fclose(fp);
+		delete mesh;
+		return readSML(file);
+	}
+	
+	uint64_t directoryEnd = ftell64(fp);
+	uint32_t count;
+	memcpy(&count, directory.data(), 4);
+	assert(directory.size() == 4 + (size_t)count * SML_TILE_ENTRY);
+	vector<uint64_t> offsets;
+	vector<vector<uint8_t>> payloads;
+	for (uint32_t i = 0; i < count; i++) {
+		const uint8_t* entry = &directory[4 + (size_t)i * SML_TILE_ENTRY];
+		float bounds[6];
+		memcpy(bounds, entry, 24);
+		bool overlaps = true;
+		for (int a = 0; a < 3; a++) {
+			if (bounds[a] > hi[a] || bounds[a + 3] < lo[a]) overlaps = false;
+		}
+		if (!overlaps) continue;
+		
+		uint64_t offset;
+		uint32_t tileLength;
+		memcpy(&offset, entry + 24, 8);
+		memcpy(&tileLength, entry + 32, 4);
+		offsets.push_back(directoryEnd + offset);
+		fseek64(fp, directoryEnd + offset, SEEK_SET);
+		size_t ret = fread(&type, 1, 1, fp);
+		ret += fread(&length, 4, 1, fp);
+		if (ret != 2 || type != 16 || length != tileLength) {
+			fprintf(stderr, "Error: Tile %u doesn't match the directory.\n", i);
+			exit(__LINE__);
+		}
+		payloads.emplace_back(length);
+		ret = fread(payloads.back().data(), 1, length, fp);
+		assert(ret == length);
+	}
+	fclose(fp);
+	printf("Reading %u of %u tiles...", (uint32_t)payloads.size(), count);
+	fflush(stdout);
+	
+	vector<Mesh> parts(payloads.size());
+	atomic<bool> ok(true);
+	parallelFor(payloads.size(), SMLOptions().threads, [&](size_t i) {
+		if (indexed) {
+			auto entry = lower_bound(index.begin(), index.end(), offsets[i], [](const IndexEntry& e, uint64_t offset) {
+				return e.offset < offset;
+			});
+			if (entry == index.end() || entry->offset != offsets[i] || crc32c(0, payloads[i].data(), payloads[i].size()) != entry->crc) {
+				fprintf(stderr, "Error: CRC mismatch in tile at %llu.\n", (unsigned long long)offsets[i]);
+				ok = false;
+				return;
+			}
+		}
+		readTile(&parts[i], payloads[i], 1);
+		vector<uint8_t>().swap(payloads[i]);
+	});
+	if (!ok) exit(__LINE__);
+	for (auto& part : parts) {
+		appendMesh(mesh, part, true);
+	}
+	printf("Done.\n");
+	return mesh;
+}
+
+Mesh* readSMLLevels(std::filesystem::path file, int levels) {
+	FILE* fp = openSML(file);
+	Mesh* mesh = new Mesh();
+	
+	// A prefix can't be checked against the whole-file CRC, so this relies on the index, if there is one.
+	vector<IndexEntry> index;
+	bool indexed = readIndex(fp, index);
+	fseek64(fp, 8, SEEK_SET);
+	
+	uint8_t type;
+	uint32_t length;
+	vector<uint8_t> payload;
+	int refinements = 0;
+	while (fread(&type, 1, 1, fp) == 1 && fread(&length, 4, 1, fp) == 1) {
+		uint64_t offset = ftell64(fp) - 5;
+		uint8_t inner = type;
+		if (type == 14) break;
+		payload.resize(length);
+		size_t ret = fread(payload.data(), 1, length, fp);
+		assert(ret == length);
+		if (type == 11 && length > 0) inner = payload[0];
+		if (inner == 18 && refinements++ == levels) break;
+		
+		if (indexed) {
+			auto entry = lower_bound(index.begin(), index.end(), offset, [](const IndexEntry& e, uint64_t offset) {
+				return e.offset < offset;
+			});
+			if (entry == index.end() || entry->offset != offset || crc32c(0, payload.data(), payload.size()) != entry->crc) {
+				fprintf(stderr, "Error: CRC mismatch in segment at %llu.\n", (unsigned long long)offset);
+				exit(__LINE__);
+			}
+		}
+		readSegment(mesh, type, payload, SMLOptions().threads);
+	}
+	fclose(fp);
+	printf("Read %d refinement%s, %u triangles.\n", min(refinements, levels), min(refinements, levels) == 1 ? "" : "s",
+		(uint32_t)mesh->t.size());
+	return mesh;
+}
+
+
+// Takes (len) bytes that came last off the end of a CRC32C, leaving the CRC of what came before them, by running the
+// shift register backwards a bit at a time.
+static uint32_t crc32cUnappend(uint32_t crc, const uint8_t* buf, size_t len) {
+	uint32_t state = ~crc;
+	while (len--) {
+		for (int bit = 0; bit < 8; bit++) {
+			state = (state & 0x80000000) ? ((state ^ 0x82F63B78) << 1) | 1 : state << 1;
+		}
+		state ^= buf[len];
+	}
+	return ~state;
+}
+
+void appendSML(filesystem::path file, const vector<pair<uint8_t, vector<uint8_t>>>& segments) {
+	#ifdef _WIN32
+		printf("Appending to %ls...", file.c_str());
+		fflush(stdout);
+		FILE* fp = _wfopen(file.c_str(), L"rb+");
+		if (!fp) {
+			fprintf(stderr, "Could not open SML file '%ls' for writing: %s\n", file.c_str(), strerror(errno));
+			exit(__LINE__);
+		}
+	#else
+		printf("Appending to %s...", file.c_str());
+		fflush(stdout);
+		FILE* fp = fopen(file.c_str(), "r+");
+		if (!fp) {
+			fprintf(stderr, "Could not open SML file '%s' for writing: %m\n", file.c_str());
+			exit(__LINE__);
+		}
+	#endif
+	
+	char magic[4];
+	uint32_t crc;
+	if (fread(magic, 1, 4, fp) != 4 || memcmp(magic, "SML1", 4) || fread(&crc, 4, 1, fp) != 1) {
+		fprintf(stderr, "Error: Not an SML file.\n");
+		exit(__LINE__);
+	}
+	
+	// An index has to stay last and list everything, so it comes off and goes back on after the new segments, taking
+	// its bytes back out of the CRC on the way.
+	vector<IndexEntry> index;
+	bool indexed = readIndex(fp, index);
+	fseek64(fp, 0, SEEK_END);
+	uint64_t end = ftell64(fp);
+	if (indexed) {
+		uint64_t length = (uint64_t)index.size() * SML_INDEX_ENTRY + 12 + 5;
+		vector<uint8_t> old(length);
+		end -= length;
+		fseek64(fp, end, SEEK_SET);
+		size_t ret = fread(old.data(), 1, length, fp);
+		assert(ret == length);
+		crc = crc32cUnappend(crc, old.data(), length);
+	}
+	
+	vector<uint8_t> out;
+	for (auto& segment : segments) {
+		uint8_t type = segment.first;
+		const vector<uint8_t>& payload = segment.second;
+		assert(type != 14 && type != 15 && type != 17);
+		if (payload.size() > 0xFFFFFFFF) {
+			fprintf(stderr, "Error: A %llu byte segment is more than one segment can hold.\n", (unsigned long long)payload.size());
+			exit(__LINE__);
+		}
+		uint32_t length = payload.size();
+		if (indexed) {
+			IndexEntry entry;
+			entry.offset = end + out.size();
+			entry.length = length;
+			entry.type = entry.inner = type;
+			entry.crc = crc32c(0, payload.data(), length);
+			Mesh part;
+			vector<uint8_t> copy(payload);
+			readSegment(&part, type, copy, SMLOptions().threads);
+			entry.elements = min(part.v.size() + part.t.size() + part.q.size(), (size_t)0xFFFFFFFF);
+			index.push_back(entry);
+		}
+		out.push_back(type);
+		out.insert(out.end(), (const uint8_t*)&length, (const uint8_t*)&length + 4);
+		out.insert(out.end(), payload.begin(), payload.end());
+	}
+	if (indexed) {
+		vector<uint8_t> payload;
+		packIndex(index, payload);
+		uint32_t length = payload.size();
+		out.push_back(14);
+		out.insert(out.end(), (const uint8_t*)&length, (const uint8_t*)&length + 4);
+		out.insert(out.end(), payload.begin(), payload.end());
+	}
+	
+	// The file only ever gets longer: a new index is bigger than the old one by at least the entries for what's new.
+	fseek64(fp, end, SEEK_SET);
+	if (fwrite(out.data(), 1, out.size(), fp) != out.size()) {
+		fprintf(stderr, "Error: Could not write to SML file: %s\n", strerror(errno));
+		exit(__LINE__);
+	}
+	crc = crc32c(crc, out.data(), out.size());
+	fseek64(fp, 4, SEEK_SET);
+	fwrite(&crc, 4, 1, fp);
+	if (fclose(fp)) {
+		fprintf(stderr, "Error: Could not write to SML file: %s\n", strerror(errno));
+		exit(__LINE__);
+	}
+	printf("%u segment%s, CRC now %08x.\n", (uint32_t)segments.size(), segments.size() == 1 ? "" : "s", crc);
+}
+
+void readSMLComments(filesystem::path file, vector<string>& comments) {
+	FILE* fp = openSML(file);
+	fseek64(fp, 8, SEEK_SET);
+	uint8_t type;
+	uint32_t length;
+	while (fread(&type, 1, 1, fp) == 1 && fread(&length, 4, 1, fp) == 1) {
+		if (type != 0) {
+			fseek64(fp, length, SEEK_CUR);
+			continue;
+		}
+		vector<char> text(length);
+		if (fread(text.data(), 1, length, fp) != length) break;
+		comments.emplace_back(text.data(), strnlen(text.data(), length));
+	}
+	fclose(fp);
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define SML_H
 
 #include "config.h"
+#include <thread>
 #include "mesh.h"
 
 extern "C" {
@@ -16,15 +17,112 @@ enum SMLFlags {
 	STRIP_MAP			= 0b0010,
 	STRIP_EXHAUSTIVE	= 0b0100,
 	STRIP_LINK          = 0b1000,
-	STRIP               = 0b1111
+	STRIP_PARALLEL		= 0b10000,
+	STRIP_GREEDY		= 0b100000,
+	STRIP               = 0b111111,
+	PACK_STRIPS			= 0b1000000,
+	JOIN_STRIPS			= 0b10000000,
+	REORDER_MORTON		= 0b100000000,
+	REORDER_HILBERT		= 0b1000000000,
+	REORDER				= 0b100000000000001100000000,
+	GRID_VERTICES		= 0b10000000000,
+	QUANTIZE_VERTICES	= 0b100000000000,
+	VARINT_INDICES		= 0b1000000000000,
+	COMPRESS			= 0b10000000000000,
+	PREDICT_VERTICES	= 0b100000000000000,
+	EDGEBREAKER			= 0b1000000000000000,
+	INDEX				= 0b10000000000000000,
+	TILES				= 0b100000000000000000,
+	LEVELS				= 0b1000000000000000000,
+	INSTANCES			= 0b10000000000000000000,
+	QUADS				= 0b100000000000000000000,
+	FANS				= 0b1000000000000000000000,
+	DOUBLE_VERTICES		= 0b10000000000000000000000,
+	REORDER_CACHE		= 0b100000000000000000000000
 };
 
+struct StripProgress {
+	size_t total;		// Triangles to strip.
+	size_t done;		// Triangles taken off the queue so far, into strips or as singles.
+	size_t stripped;	// Triangles put into strips so far.
+	double elapsed;		// Seconds since the search started.
+	double eta;			// Estimated seconds left, or negative if unknown.
+	
+	double coverage() const { return total ? (double)stripped / total : 0.0; }
+};
+typedef void (*StripProgressCallback)(const StripProgress& progress, void* data);
+
+struct SMLOptions {
+	unsigned int threads;	// Worker threads for STRIP_PARALLEL, REORDER, COMPRESS and INDEX.
+	bool stitch;			// Join strips across region borders after STRIP_PARALLEL.
+	double stripBudget;		// Seconds the strip search may take before the rest is written as singles, 0 for no limit.
+	StripProgressCallback progress;	// Called about once a second during the strip search.
+	void* progressData;
+	int quantizeBits;		// Bits per axis for QUANTIZE_VERTICES, 10 to 16, or 0 to pick from quantizeError.
+	double quantizeError;	// Largest error allowed for QUANTIZE_VERTICES, in model units, when quantizeBits is 0.
+							// If 16 bits can't get within it, the vertices are written losslessly.
+	size_t chunkSize;		// Most vertices, triangles or quads per segment with INDEX, or 0 for no limit.
+	unsigned int tiles[3];	// Tiles along x, y and z for TILES.
+	int lodLevels;			// Refinements after the base mesh for LEVELS, each doubling the triangle count.
+	unsigned int fanMin;	// Fewest triangles in a fan for FANS.
+	
+	SMLOptions() {
+		threads = std::thread::hardware_concurrency();
+		if (threads < 1) threads = 1;
+		stitch = true;
+		stripBudget = 0;
+		progress = NULL;
+		progressData = NULL;
+		quantizeBits = 16;
+		quantizeError = 0;
+		chunkSize = 262144;
+		tiles[0] = tiles[1] = 1;
+		tiles[2] = 16;
+		lodLevels = 6;
+		fanMin = 12;
+	}
+};
+
+// What the stats segment (type 17) at the start of a file says about the mesh in it.
+struct SMLStats {
+	float min[3], max[3];	// Bounding box.
+	uint64_t vertices;
+	uint64_t triangles;		// Including those in strips and everything else that decodes to triangles.
+	uint64_t quads;
+	double area;			// Surface area, counting quads as two triangles.
+	double volume;			// Signed volume enclosed, only meaningful for closed meshes.
+	uint64_t hash;			// Content hash of the triangles and quads, independent of how they're stored.
+	bool lossy;				// Vertices were stored lossily, so the figures describe the original mesh.
+};
+
+// Reads a whole file. Files with a segment index are checked segment by segment against it, and their whole-file CRC
+// is left unchecked.
 Mesh* readSML(std::filesystem::path file);
-void writeSML(std::filesystem::path file, Mesh* mesh, uint32_t writeFlags = SMLFlags::NONE);
+// Checks that a file opens, starts like an SML file and matches its CRC. Unlike the readers, prints why to stderr and
+// returns false if not, instead of exiting.
+bool checkSML(std::filesystem::path file);
+// Reads just the stats segment from the start of a file. Returns false if there isn't one.
+bool readSMLStats(std::filesystem::path file, SMLStats& stats);
+// Reads only the tiles of a file written with TILES whose bounds overlap the box from lo to hi. Triangles come a whole
+// tile at a time, so some will reach outside the box. Files without tiles are read in full.
+Mesh* readSMLRegion(std::filesystem::path file, const float lo[3], const float hi[3]);
+// Reads a file written with LEVELS only up to the end of the given number of refinements, for a quick preview.
+// Files without them are read in full.
+Mesh* readSMLLevels(std::filesystem::path file, int levels);
+void writeSML(std::filesystem::path file, Mesh* mesh, uint32_t writeFlags = SMLFlags::NONE, const SMLOptions& options = SMLOptions());
+// Adds segments (type and payload) to the end of an existing file without reading the rest of it: the new CRC carries on
+// from the old one, and a segment index is rebuilt from its own entries. Stats, index and tile directory segments have
+// places of their own and can't be added this way.
+void appendSML(std::filesystem::path file, const std::vector<std::pair<uint8_t, std::vector<uint8_t>>>& segments);
+// Reads just the comments at the top level of a file, seeking past everything else.
+void readSMLComments(std::filesystem::path file, std::vector<std::string>& comments);
 
-void stripsearch_map(Mesh* mesh, std::list<Triangle*>& singles, std::list<std::list<Triangle*>>& strips);
-void stripsearch_next(Mesh* mesh, std::list<Triangle*>& singles, std::list<std::list<Triangle*>>& strips);
-void stripsearch_exhaustive(Mesh* mesh, std::list<Triangle*>& singles, std::list<std::list<Triangle*>>& strips);
-void stripsearch_link(Mesh* mesh, std::list<Triangle*>& singles, std::list<std::list<Triangle*>>& strips);
+void stripsearch_map(Mesh* mesh, std::list<Triangle*>& singles, std::list<std::list<Triangle*>>& strips, const SMLOptions& options = SMLOptions());
+void stripsearch_next(Mesh* mesh, std::list<Triangle*>& singles, std::list<std::list<Triangle*>>& strips, const SMLOptions& options = SMLOptions());
+void stripsearch_exhaustive(Mesh* mesh, std::list<Triangle*>& singles, std::list<std::list<Triangle*>>& strips, const SMLOptions& options = SMLOptions());
+void stripsearch_link(Mesh* mesh, std::list<Triangle*>& singles, std::list<std::list<Triangle*>>& strips, const SMLOptions& options = SMLOptions());
+void stripsearch_greedy(Mesh* mesh, std::list<Triangle*>& singles, std::list<std::list<Triangle*>>& strips, const SMLOptions& options = SMLOptions());
+void stripsearch_parallel(Mesh* mesh, std::list<Triangle*>& singles, std::list<std::list<Triangle*>>& strips, const SMLOptions& options = SMLOptions());
+void fansearch(Mesh* mesh, std::vector<std::vector<uint32_t>>& fans, std::vector<std::shared_ptr<Triangle>>& rest, unsigned int minimum);
 
 #endif
\ No newline at end of file
@@ -10,6 +10,7 @@
 #include "mesh.h"
 #include "stl.h"
 #include "sml.h"
+#include "meshopt.h"
 
 using namespace std;
 
@@ -17,6 +18,10 @@ using namespace std;
 #include <getopt.h>
 
 static const struct option longopts[] = {
+	{"region",		required_argument,	0,   2 },
+	{"stats",		no_argument,		0,   3 },
+	{"levels",		required_argument,	0,   4 },
+	{"cache",		optional_argument,	0,   5 },
 	{"rm",			no_argument,		0,   1 },
 	{"help",		no_argument,		0,	'h'},
 	{0, 0, 0, 0}
@@ -25,6 +30,11 @@ static const struct option longopts[] = {
 
 int main(int argc, char* argv[]) {
 	bool rm = 0;
+	bool region = false;
+	bool statsOnly = false;
+	int levels = -1;
+	unsigned int cacheSize = 0;
+	float lo[3], hi[3];
 	
 	#ifdef _MSC_VER
 	int optind = 1;
@@ -40,9 +50,38 @@ int main(int argc, char* argv[]) {
 				rm = 1;
 				break;
 			
+			case 2:
+				if (sscanf(optarg, "%f,%f,%f,%f,%f,%f", &lo[0], &lo[1], &lo[2], &hi[0], &hi[1], &hi[2]) != 6) {
+					fprintf(stderr, "Error: Region must be x0,y0,z0,x1,y1,z1.\n");
+					return 1;
+				}
+				region = true;
+				break;
+			
+			case 3:
+				statsOnly = true;
+				break;
+			
+			case 4:
+				levels = atoi(optarg);
+				break;
+			
+			case 5:
+				cacheSize = optarg ? atoi(optarg) : 16;
+				if (cacheSize < 3) {
+					fprintf(stderr, "Error: Cache size must be at least 3.\n");
+					return 1;
+				}
+				break;
+			
 			case 'h':
 				printf("Usage: %s [options] <file.stl>...\n"
 					"Options:\n"
+					"--region=x0,y0,z0,x1,y1,z1   Only read the tiles that overlap this box, from a file written with --tiles.\n"
+					"--stats                      Print the stats stored at the start of each file instead of converting it.\n"
+					"--levels=n                   Only read the base mesh and n refinements from a file written with --lod.\n"
+					"--cache[=size]               Print how well each file's triangles use a GPU vertex cache of this many entries\n"
+					"                             (default 16), in the order they decode, instead of converting it.\n"
 					"--rm                         Remove original file after converting.\n"
 					, argv[0]);
 				return 1;
@@ -52,7 +91,31 @@ int main(int argc, char* argv[]) {
 	
 	for (int i = optind; i < argc; i++) {
 		filesystem::path file(argv[i]);
-		Mesh* mesh = readSML(file);
+		if (statsOnly) {
+			SMLStats stats;
+			if (!readSMLStats(file, stats)) {
+				printf("No stats.\n\n");
+				continue;
+			}
+			printf("Bounds: %g,%g,%g to %g,%g,%g\n", stats.min[0], stats.min[1], stats.min[2], stats.max[0], stats.max[1], stats.max[2]);
+			printf("Vertices: %llu\nTriangles: %llu\nQuads: %llu\n", (unsigned long long)stats.vertices,
+				(unsigned long long)stats.triangles, (unsigned long long)stats.quads);
+			printf("Area: %g\nVolume: %g\nHash: %016llx%s\n\n", stats.area, stats.volume, (unsigned long long)stats.hash,
+				stats.lossy ? " (before lossy vertex storage)" : "");
+			continue;
+		}
+		Mesh* mesh;
+		if (region) mesh = readSMLRegion(file, lo, hi);
+		else if (levels >= 0) mesh = readSMLLevels(file, levels);
+		else mesh = readSML(file);
+		
+		if (cacheSize) {
+			double acmr, atvr;
+			measureVertexCache(mesh, cacheSize, acmr, atvr);
+			printf("ACMR: %.3f\nATVR: %.3f\n\n", acmr, atvr);
+			delete mesh;
+			continue;
+		}
 		
 		file.replace_extension(".stl");
 		writeSTL(file, mesh);
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <assert.h>
+
+#include <list>
+#include <vector>
+#include <string>
+
+#include "config.h"
+#include "mesh.h"
+#include "sml.h"
+
+using namespace std;
+
+#ifndef _MSC_VER
+#include <getopt.h>
+
+static const struct option longopts[] = {
+	{"comment",		required_argument,	0,	'c'},
+	{"help",		no_argument,		0,	'h'},
+	{0, 0, 0, 0}
+};
+#endif
+
+int main(int argc, char* argv[]) {
+	vector<string> comments;
+	
+	#ifdef _MSC_VER
+	int optind = 1;
+	#else
+	while (1) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "c:h", longopts, &option_index);
+		if (c == -1) break;
+		
+		switch (c) {
+			case 'c': {
+				comments.emplace_back(optarg);
+			} break;
+			
+			case 'h':
+				printf("Usage: %s [options] <file.sml>...\n"
+					"Lists the comments in each file, or with -c, adds to them in place. Adding only reads and writes the end of\n"
+					"the file, however big it is.\n"
+					"Options:\n"
+					"-c=<...> --comment=<...>     Add the specified text to the end of each file as a comment.\n"
+					"                             Can be used more than once for multiple comments.\n"
+					, argv[0]);
+				return 1;
+		}
+	}
+	#endif
+	
+	vector<pair<uint8_t, vector<uint8_t>>> segments;
+	for (auto& comment : comments) {
+		// With the NUL on the end, as writeSML writes them, for readers that take them as C strings.
+		segments.emplace_back(0, vector<uint8_t>(comment.c_str(), comment.c_str() + comment.length() + 1));
+	}
+	
+	for (int i = optind; i < argc; i++) {
+		filesystem::path file(argv[i]);
+		if (segments.empty()) {
+			vector<string> found;
+			readSMLComments(file, found);
+			for (auto& comment : found) {
+				printf("%s\n", comment.c_str());
+			}
+		} else {
+			appendSML(file, segments);
+		}
+		printf("\n");
+	}
+	
+	printf("\nAll done.\n");
+	return 0;
+}
\ No newline at end of file
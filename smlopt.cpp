@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <assert.h>
+
+#include <iostream>
+#include <fstream>
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#include "config.h"
+#include "mesh.h"
+#include "sml.h"
+#include "meshopt.h"
+#include "cliopts.h"
+
+using namespace std;
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+int main(int argc, char* argv[]) {
+	WriteArgs args(SMLFlags::STRIP_LINK);
+	SMLOptions& options = args.options;
+	unsigned int jobs = 1;
+	bool force = 0;
+
+	#ifdef _MSC_VER
+	int optind = 1;
+	#else
+	vector<struct option> longopts;
+	addWriteOptions(longopts, false);
+	longopts.push_back({"jobs",		required_argument,	0,	'j'});
+	longopts.push_back({"force",	no_argument,		0,   1 });
+	longopts.push_back({"help",		no_argument,		0,	'h'});
+	longopts.push_back({0, 0, 0, 0});
+	
+	while (1) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, WRITE_SHORTOPTS "j:h", longopts.data(), &option_index);
+		if (c == -1) break;
+		if (parseWriteOption(c, optarg, args)) continue;
+		
+		switch (c) {
+			case 'j':
+				jobs = atoi(optarg[0] == '=' ? optarg + 1 : optarg);
+				if (jobs < 1) {
+					fprintf(stderr, "Error: Jobs must be at least 1.\n");
+					return 1;
+				}
+				break;
+			
+			case 1:
+				force = 1;
+				break;
+			
+			case 'h':
+				printf("Usage: %s [options] <file.sml>...\n"
+					"Re-encodes SML files in place with the options given, keeping each one only if it comes out smaller.\n"
+					"Comments already in a file are kept, and any given with -c go after them.\n"
+					"Options:\n", argv[0]);
+				printWriteHelp(args, NULL);
+				printf("-j=<n> --jobs=<n>            Work on this many files at once. Prints one line per file instead of progress.\n"
+					"--force                      Replace files even if they don't get smaller.\n");
+				return 1;
+		}
+	}
+	#endif
+	
+	// With several jobs, their progress messages would be a jumble, so they go nowhere and each file gets a line instead.
+	FILE* report = stdout;
+	#ifndef _MSC_VER
+	if (jobs > 1) {
+		fflush(stdout);
+		report = fdopen(dup(fileno(stdout)), "w");
+		if (!report || !freopen("/dev/null", "w", stdout)) {
+			fprintf(stderr, "Error: Could not redirect output: %s\n", strerror(errno));
+			return 1;
+		}
+		if (options.threads > jobs) options.threads /= jobs;
+		else options.threads = 1;
+	}
+	#endif
+	
+	// readSML exits on a file it can't read, which would take every job down with it and leave their .tmp files behind,
+	// so files that don't open or don't match their CRC are reported and skipped before any work starts.
+	vector<const char*> files;
+	for (int i = optind; i < argc; i++) {
+		if (checkSML(argv[i])) {
+			files.push_back(argv[i]);
+		} else {
+			fprintf(report, "%s: Not a readable SML file, skipped.\n\n", argv[i]);
+		}
+	}
+	fflush(report);
+	
+	mutex reportLock;
+	atomic<size_t> nextFile(0);
+	atomic<uint64_t> saved(0);
+	auto work = [&]() {
+		for (size_t i = nextFile++; i < files.size(); i = nextFile++) {
+			filesystem::path file(files[i]);
+			filesystem::path temp(file);
+			temp += ".tmp";
+			
+			Mesh* mesh = readSML(file);
+			if (mesh->rounded) {
+				// Reading rounds them to floats, so writing them back would lose what they were there for.
+				lock_guard<mutex> lock(reportLock);
+				fprintf(report, "%s: Has double-precision vertices, skipped.\n\n", files[i]);
+				fflush(report);
+				delete mesh;
+				continue;
+			}
+			if (args.weld > 0) weldVertices(mesh, args.weld);
+			compactVertices(mesh, options.threads);
+			mesh->comments.insert(mesh->comments.end(), args.comments.begin(), args.comments.end());
+			
+			writeSML(temp, mesh, args.flags, options);
+			delete mesh;
+			
+			uint64_t before = filesystem::file_size(file);
+			uint64_t after = filesystem::file_size(temp);
+			bool replace = after < before || force;
+			if (replace) filesystem::rename(temp, file);
+			else filesystem::remove(temp);
+			
+			lock_guard<mutex> lock(reportLock);
+			if (replace) {
+				if (after < before) saved += before - after;
+				fprintf(report, "%s: %llu -> %llu bytes, replaced.\n", files[i], (unsigned long long)before, (unsigned long long)after);
+			} else {
+				fprintf(report, "%s: %llu -> %llu bytes, not smaller, left alone.\n", files[i], (unsigned long long)before,
+					(unsigned long long)after);
+			}
+			fprintf(report, "\n");
+			fflush(report);
+		}
+	};
+	
+	vector<thread> workers;
+	for (unsigned int t = 1; t < jobs && t < files.size(); t++) {
+		workers.emplace_back(work);
+	}
+	work();
+	for (auto& worker : workers) worker.join();
+	
+	fprintf(report, "\nAll done, %llu bytes saved.\n", (unsigned long long)saved);
+	return (int)files.size() < argc - optind;
+}
\ No newline at end of file
@@ -23,7 +23,7 @@ Mesh* readSTL(filesystem::path file) {
 	
 	uint32_t triCount;
 	fread(&triCount, 4, 1, fp);
-	if (84 + (triCount*50) != filesystem::file_size(file)) {
+	if (84 + (uint64_t)triCount * 50 != filesystem::file_size(file)) {
 		fprintf(stderr, "File '%s' size did not match triangle count %u.\n", file.c_str(), triCount);
 		exit(__LINE__);
 	}
@@ -31,7 +31,7 @@ Mesh* readSTL(filesystem::path file) {
 	Mesh* mesh = new Mesh();
 	
 	printf("Reading %u triangles...\n", triCount);
-	mesh->v.reserve(triCount*3);
+	mesh->v.reserve((size_t)triCount * 3);
 	mesh->t.reserve(triCount);
 	
 	STLTri stltri;
@@ -82,30 +82,31 @@ void writeSTL(filesystem::path file, Mesh* mesh) {
 	size_t ret = fwrite(header, 1, 80, fp);
 	assert(ret == 80);
 	
-	uint32_t triCount = mesh->t.size();
+	// STL only has triangles, so quads go out as two each.
+	size_t total = mesh->t.size() + mesh->q.size() * 2;
+	if (total > 0xFFFFFFFF) {
+		fprintf(stderr, "STL can't hold %llu triangles, only 2^32-1.\n", (unsigned long long)total);
+		exit(__LINE__);
+	}
+	uint32_t triCount = total;
 	fwrite(&triCount, 4, 1, fp);
 	
 	STLTri stltri;
 	memset(&stltri, 0, sizeof(stltri));
 	
-	for (auto& i : mesh->t) {
-		shared_ptr<Vertex> v = mesh->v[i->a];
-		stltri.v[0][0] = v->x;
-		stltri.v[0][1] = v->y;
-		stltri.v[0][2] = v->z;
-
-		v = mesh->v[i->b];
-		stltri.v[1][0] = v->x;
-		stltri.v[1][1] = v->y;
-		stltri.v[1][2] = v->z;
-
-		v = mesh->v[i->c];
-		stltri.v[2][0] = v->x;
-		stltri.v[2][1] = v->y;
-		stltri.v[2][2] = v->z;
-		
-		ret = fwrite(&stltri, sizeof(stltri), 1, fp);
+	auto writeTri = [&](uint32_t a, uint32_t b, uint32_t c) {
+		memcpy(stltri.v[0], mesh->v[a]->c, 12);
+		memcpy(stltri.v[1], mesh->v[b]->c, 12);
+		memcpy(stltri.v[2], mesh->v[c]->c, 12);
+		size_t ret = fwrite(&stltri, sizeof(stltri), 1, fp);
 		assert(ret == 1);
+	};
+	for (auto& i : mesh->t) {
+		writeTri(i->a, i->b, i->c);
+	}
+	for (auto& i : mesh->q) {
+		writeTri(i->a, i->b, i->c);
+		writeTri(i->a, i->c, i->d);
 	}
 	
 	fclose(fp);
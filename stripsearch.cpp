@@ -2,9 +2,17 @@
 #include <stdio.h>
 #include <list>
 #include <map>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
 #ifdef USE_SPARSEHASH
 #include <sparsehash/sparse_hash_map>
 #include <sparsehash/dense_hash_set>
+#include <sparsehash/dense_hash_map>
 using namespace google;
 #else
 #include <unordered_map>
@@ -16,7 +24,110 @@ using namespace google;
 
 using namespace std;
 
-void stripsearch_map(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>>& strips) {
+// Progress shared by the timers of searches running side by side, so the callback sees them as one search.
+struct StripShared {
+	size_t total;
+	atomic<size_t> done;
+	atomic<size_t> stripped;
+	mutex lock;		// Held while reporting, so only one of the searches does it each second.
+	chrono::steady_clock::time_point nextUpdate;
+};
+
+// Tracks how far a strip search has got: prints it once a second if verbose, hands it to the progress callback if there
+// is one, and checks it against the time budget.
+class StripTimer {
+	StripProgress progress;
+	const SMLOptions& options;
+	bool verbose;
+	StripShared* shared;
+	chrono::steady_clock::time_point start;
+	chrono::steady_clock::time_point nextUpdate;
+	
+	void report(chrono::steady_clock::time_point now) {
+		if (shared) {
+			unique_lock<mutex> lock(shared->lock, try_to_lock);
+			if (!lock.owns_lock() || now < shared->nextUpdate) return;
+			shared->nextUpdate = now + chrono::seconds(1);
+			StripProgress all = progress;
+			all.total = shared->total;
+			all.done = shared->done;
+			all.stripped = shared->stripped;
+			all.eta = all.done ? all.elapsed * (all.total - all.done) / all.done : -1;
+			if (options.progress) options.progress(all, options.progressData);
+			return;
+		}
+		
+		size_t remaining = progress.total - progress.done;
+		progress.eta = progress.done ? progress.elapsed * remaining / progress.done : -1;
+		if (verbose) {
+			printf("%lu left, %.1f%% stripped, ETA %.0fs   ", (unsigned long)remaining, progress.coverage() * 100.0, progress.eta);
+			fflush(stdout);
+			printf("\r");
+		}
+		if (options.progress) options.progress(progress, options.progressData);
+	}
+	
+public:
+	StripTimer(size_t total, const SMLOptions& opts, bool verb = true, chrono::steady_clock::time_point began = chrono::steady_clock::now(),
+		StripShared* sh = NULL)
+		: options(opts), verbose(verb), shared(sh), start(began)
+	{
+		progress.total = total;
+		progress.done = 0;
+		progress.stripped = 0;
+		progress.elapsed = 0;
+		progress.eta = -1;
+		nextUpdate = chrono::steady_clock::now() + chrono::seconds(1);
+		if (verbose) printf("Finding strips:\n");
+	}
+	
+	// Called before starting each strip. Returns false once the budget has run out.
+	bool tick() {
+		auto now = chrono::steady_clock::now();
+		progress.elapsed = chrono::duration<double>(now - start).count();
+		
+		if (now > nextUpdate) {
+			report(now);
+			nextUpdate = now + chrono::seconds(1);
+		}
+		
+		if (options.stripBudget > 0 && progress.elapsed > options.stripBudget) {
+			if (verbose) printf("\nStrip budget of %gs used up, writing %lu remaining triangles as singles.", options.stripBudget,
+				(unsigned long)(progress.total - progress.done));
+			return false;
+		}
+		return true;
+	}
+	
+	// For searches where a single strip can take a long time to grow, so they can cut it short.
+	bool expired() const {
+		return options.stripBudget > 0 && chrono::duration<double>(chrono::steady_clock::now() - start).count() > options.stripBudget;
+	}
+	
+	void strip(size_t length) {
+		progress.stripped += length;
+		progress.done += length;
+		if (shared) {
+			shared->stripped += length;
+			shared->done += length;
+		}
+	}
+	void single() {
+		progress.done++;
+		if (shared) shared->done++;
+	}
+	
+	// With shared progress, whoever started the searches reports the end of them all.
+	void finish() {
+		if (shared) shared->done += progress.total - progress.done;
+		progress.done = progress.total;
+		progress.eta = 0;
+		if (!shared && options.progress) options.progress(progress, options.progressData);
+		if (verbose) printf("\nDone.\n");
+	}
+};
+
+void stripsearch_map(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>>& strips, const SMLOptions& options) {
 	list<Triangle*> queue;
 	uint32_t queueSize = 0;
 	for (auto& i : mesh->t) {
@@ -36,20 +147,15 @@ void stripsearch_map(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>>
 	list<Triangle*> strip;
 	//map<uint32_t,uint32_t> striplengths;
 	time_t tNow = time(NULL);
-	time_t nextUpdate = tNow + 1;
 	time_t nextCompact = tNow + 60;
-	printf("Finding strips:\n");
+	StripTimer timer(queueSize, options);
 	while (!queue.empty()) {
 		tNow = time(NULL);
-		if (tNow > nextUpdate) {
-			/*printf("queued=%lu ", queue.size());
-			for (auto& i : striplengths) {
-				printf("%u=%u ", i.first, i.second);
-			}*/
-			printf("%lu ", (unsigned long)queueSize);
-			fflush(stdout);
-			printf("\r");
-			nextUpdate = tNow + 1;
+		if (!timer.tick()) {
+			for (Triangle* t : queue) {
+				if (used.find(t) == used.end()) singles.push_back(t);
+			}
+			break;
 		}
 		if (tNow > nextCompact && dirtiness >= 10000) {
 			printf("Compacting, dirtiness %u.\n", dirtiness);
@@ -170,7 +276,7 @@ void stripsearch_map(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>>
 						if (found) break;
 					}
 				}
-			} while (keepgoing);
+			} while (keepgoing && !timer.expired());
 			
 			if (count > 1) break;
 			uint32_t temp = prev->a;
@@ -180,8 +286,10 @@ void stripsearch_map(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>>
 		}
 		
 		if (count == 1) {
+			timer.single();
 			singles.push_back(prev);
 		} else {
+			timer.strip(count);
 			strips.push_back(move(strip));
 		}
 		
@@ -194,12 +302,12 @@ void stripsearch_map(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>>
 		
 		strip.clear();
 	}
-	printf("\nDone.\n");
+	timer.finish();
 }
 
 
 
-void stripsearch_next(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>>& strips) {
+void stripsearch_next(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>>& strips, const SMLOptions& options) {
 	list<Triangle*> queue;
 	for (auto& i : mesh->t) {
 		queue.push_back(i.get());
@@ -207,23 +315,15 @@ void stripsearch_next(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>
 	
 	list<Triangle*> strip;
 	//map<uint32_t,uint32_t> striplengths;
-	time_t nextUpdate = time(NULL) + 1;
-	printf("Finding strips:\n");
+	StripTimer timer(queue.size(), options);
 	while (!queue.empty()) {
+		if (!timer.tick()) {
+			singles.splice(singles.end(), queue);
+			break;
+		}
 		Triangle* prev = queue.front();
 		queue.pop_front();
 		strip.push_back(prev);
-		
-		if (time(NULL) > nextUpdate) {
-			/*printf("queued=%lu ", queue.size());
-			for (auto& i : striplengths) {
-				printf("%u=%u ", i.first, i.second);
-			}*/
-			printf("%lu ", queue.size());
-			fflush(stdout);
-			printf("\r");
-			nextUpdate++;
-		}
 
 		
 		bool keepgoing;
@@ -295,7 +395,7 @@ void stripsearch_next(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>
 						break;
 					}
 				}
-			} while (keepgoing);
+			} while (keepgoing && !timer.expired());
 			
 			if (count > 1) break;
 			uint32_t temp = prev->a;
@@ -305,8 +405,10 @@ void stripsearch_next(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>
 		}
 		
 		if (count == 1) {
+			timer.single();
 			singles.push_back(prev);
 		} else {
+			timer.strip(count);
 			strips.push_back(move(strip));
 		}
 		
@@ -316,13 +418,15 @@ void stripsearch_next(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>
 		} else {
 			striplengths[count] = 1;
 		}*/
+		
+		strip.clear();
 	}
-	printf("\nDone.\n");
+	timer.finish();
 }
 
 
 
-void stripsearch_exhaustive(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>>& strips) {
+void stripsearch_exhaustive(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>>& strips, const SMLOptions& options) {
 	list<Triangle*> queue;
 	for (auto& i : mesh->t) {
 		queue.push_back(i.get());
@@ -330,23 +434,15 @@ void stripsearch_exhaustive(Mesh* mesh, list<Triangle*>& singles, list<list<Tria
 	
 	list<Triangle*> strip;
 	//map<uint32_t,uint32_t> striplengths;
-	time_t nextUpdate = time(NULL) + 1;
-	printf("Finding strips:\n");
+	StripTimer timer(queue.size(), options);
 	while (!queue.empty()) {
+		if (!timer.tick()) {
+			singles.splice(singles.end(), queue);
+			break;
+		}
 		Triangle* prev = queue.front();
 		queue.pop_front();
 		strip.push_back(prev);
-		
-		if (time(NULL) > nextUpdate) {
-			/*printf("queued=%lu ", queue.size());
-			for (auto& i : striplengths) {
-				printf("%u=%u ", i.first, i.second);
-			}*/
-			printf("%lu ", queue.size());
-			fflush(stdout);
-			printf("\r");
-			nextUpdate++;
-		}
 
 		
 		bool keepgoing;
@@ -414,7 +510,7 @@ void stripsearch_exhaustive(Mesh* mesh, list<Triangle*>& singles, list<list<Tria
 						break;
 					}
 				}
-			} while (keepgoing);
+			} while (keepgoing && !timer.expired());
 
 			if (count > 1) break;
 			uint32_t temp = prev->a;
@@ -424,8 +520,10 @@ void stripsearch_exhaustive(Mesh* mesh, list<Triangle*>& singles, list<list<Tria
 		}
 		
 		if (count == 1) {
+			timer.single();
 			singles.push_back(prev);
 		} else {
+			timer.strip(count);
 			strips.push_back(move(strip));
 		}
 		
@@ -438,7 +536,7 @@ void stripsearch_exhaustive(Mesh* mesh, list<Triangle*>& singles, list<list<Tria
 		
 		strip.clear();
 	}
-	printf("\nDone.\n");
+	timer.finish();
 }
 
 
@@ -522,7 +620,10 @@ uint32_t do_stripsearch_link(uint32_t count,
 	return count;
 }
 
-void stripsearch_link(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>>& strips) {
+// Runs the link search over the triangles in queue. Used directly by stripsearch_link, and per-region by stripsearch_parallel.
+static void stripsearch_link_queue(list<Triangle*>& queue, list<Triangle*>& singles, list<list<Triangle*>>& strips,
+		const SMLOptions& options, bool verbose, chrono::steady_clock::time_point start, StripShared* shared = NULL)
+{
 	#ifdef USE_SPARSEHASH
 	sparse_hash_map<uint32_t, TriVector*> links;
 	//links.set_empty_key(0xFFFFFFFF);
@@ -530,13 +631,12 @@ void stripsearch_link(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>
 	unordered_map<uint32_t, TriVector*> links;
 	#endif
 
-	printf("Building vertex links...");
-	fflush(stdout);
-	list<Triangle*> queue;
+	if (verbose) {
+		printf("Building vertex links...");
+		fflush(stdout);
+	}
 	uint32_t queueSize = 0;
-	for (auto& i : mesh->t) {
-		Triangle* t = i.get();
-		queue.push_back(t);
+	for (Triangle* t : queue) {
 		queueSize++;
 		
 		for (int vi = 0; vi < 3; vi++) {
@@ -549,7 +649,7 @@ void stripsearch_link(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>
 			}
 		}
 	}
-	printf("Done.\n");
+	if (verbose) printf("Done.\n");
 
 	#ifdef USE_SPARSEHASH
 	dense_hash_set<Triangle*> used(queueSize);
@@ -559,16 +659,13 @@ void stripsearch_link(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>
 	used.reserve(queueSize);
 	#endif
 	
-	time_t tNow = time(NULL);
-	time_t nextUpdate = tNow + 1;
-	printf("Finding strips:\n");
+	StripTimer timer(queueSize, options, verbose, start, shared);
 	while (!queue.empty()) {
-		tNow = time(NULL);
-		if (tNow > nextUpdate) {
-			printf("%lu ", (unsigned long)queueSize);
-			fflush(stdout);
-			printf("\r");
-			nextUpdate = tNow + 1;
+		if (!timer.tick()) {
+			for (Triangle* t : queue) {
+				if (used.find(t) == used.end()) singles.push_back(t);
+			}
+			break;
 		}
 		if (used.find(queue.front()) != used.end()) {
 			queue.pop_front();
@@ -602,6 +699,7 @@ void stripsearch_link(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>
 		}
 		
 		if (bestcount == 1) {
+			timer.single();
 			singles.push_back(start);
 		} else {
 			// If you comment out the "if (count < 1) break;" line above, uncomment this.
@@ -613,8 +711,429 @@ void stripsearch_link(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>
 				used.insert(tri);
 			}
 			
+			timer.strip(bestcount);
 			strips.push_back(move(strip[best]));
 		}
 	}
-	printf("\nDone.\n");
+	timer.finish();
+	
+	for (auto& link : links) {
+		delete link.second;
+	}
+}
+
+void stripsearch_link(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>>& strips, const SMLOptions& options) {
+	list<Triangle*> queue;
+	for (auto& i : mesh->t) {
+		queue.push_back(i.get());
+	}
+	stripsearch_link_queue(queue, singles, strips, options, true, chrono::steady_clock::now());
+}
+
+
+
+// Appends strips onto the ends of other strips where the first triangle of one is a valid continuation of the other.
+// Only strips of even length can take another strip, otherwise the alternation would be off for the rest of it.
+static void stripsearch_join(list<list<Triangle*>>& strips) {
+	vector<list<Triangle*>*> order;
+	order.reserve(strips.size());
+	#ifdef USE_SPARSEHASH
+	sparse_hash_map<uint64_t, vector<uint32_t>> heads;
+	#else
+	unordered_map<uint64_t, vector<uint32_t>> heads;
+	#endif
+	for (auto& strip : strips) {
+		Triangle* front = strip.front();
+		heads[((uint64_t)front->a << 32) | front->b].push_back(order.size());
+		order.push_back(&strip);
+	}
+	
+	vector<bool> consumed(order.size(), false);
+	for (uint32_t i = 0; i < order.size(); i++) {
+		if (consumed[i]) continue;
+		list<Triangle*>* strip = order[i];
+		
+		while (!(strip->size() & 1)) {
+			// Even length, so the next triangle needs a==c, b==b.
+			Triangle* prev = strip->back();
+			auto head = heads.find(((uint64_t)prev->c << 32) | prev->b);
+			if (head == heads.end()) break;
+			
+			uint32_t found = 0xFFFFFFFF;
+			for (uint32_t j : head->second) {
+				if (j != i && !consumed[j]) {
+					found = j;
+					break;
+				}
+			}
+			if (found == 0xFFFFFFFF) break;
+			
+			consumed[found] = true;
+			strip->splice(strip->end(), *order[found]);
+		}
+	}
+	
+	strips.remove_if([](const list<Triangle*>& strip) { return strip.empty(); });
+}
+
+void stripsearch_parallel(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>>& strips, const SMLOptions& options) {
+	auto start = chrono::steady_clock::now();
+	size_t triCount = mesh->t.size();
+	unsigned int threads = options.threads;
+	if (threads < 1) threads = 1;
+	if (triCount < (size_t)threads * 1024) threads = 1;
+	
+	// Partition the triangles into regions along a Morton curve of their centroids,
+	// so each thread gets a spatially compact chunk with few triangles on its borders.
+	printf("Partitioning %lu triangles into %u regions...", (unsigned long)triCount, threads);
+	fflush(stdout);
+	float lo[3] = { numeric_limits<float>::max(), numeric_limits<float>::max(), numeric_limits<float>::max() };
+	float hi[3] = { -numeric_limits<float>::max(), -numeric_limits<float>::max(), -numeric_limits<float>::max() };
+	vector<Vertex> centroids(triCount);
+	for (size_t i = 0; i < triCount; i++) {
+		Triangle* t = mesh->t[i].get();
+		Vertex* a = mesh->v[t->a].get();
+		Vertex* b = mesh->v[t->b].get();
+		Vertex* c = mesh->v[t->c].get();
+		for (int axis = 0; axis < 3; axis++) {
+			float f = (a->c[axis] + b->c[axis] + c->c[axis]) / 3.0f;
+			centroids[i].c[axis] = f;
+			if (f < lo[axis]) lo[axis] = f;
+			if (f > hi[axis]) hi[axis] = f;
+		}
+	}
+	vector<pair<uint64_t,uint32_t>> keys(triCount);
+	for (size_t i = 0; i < triCount; i++) {
+		uint32_t q[3];
+		for (int axis = 0; axis < 3; axis++) {
+			float range = hi[axis] - lo[axis];
+			q[axis] = range > 0 ? (uint32_t)((centroids[i].c[axis] - lo[axis]) / range * 1023.0f) : 0;
+		}
+		keys[i] = make_pair(mortonCode(q[0], q[1], q[2]), (uint32_t)i);
+	}
+	centroids.clear();
+	sort(keys.begin(), keys.end());
+	
+	vector<list<Triangle*>> queues(threads);
+	for (size_t i = 0; i < triCount; i++) {
+		queues[i * threads / triCount].push_back(mesh->t[keys[i].second].get());
+	}
+	keys.clear();
+	printf("Done.\n");
+	
+	printf("Finding strips on %u thread%s...", threads, threads == 1 ? "" : "s");
+	fflush(stdout);
+	vector<list<Triangle*>> regionSingles(threads);
+	vector<list<list<Triangle*>>> regionStrips(threads);
+	StripShared shared;
+	shared.total = triCount;
+	shared.done = 0;
+	shared.stripped = 0;
+	shared.nextUpdate = start + chrono::seconds(1);
+	vector<thread> workers;
+	for (unsigned int i = 0; i < threads; i++) {
+		workers.emplace_back(stripsearch_link_queue, ref(queues[i]), ref(regionSingles[i]), ref(regionStrips[i]), cref(options), false, start,
+			&shared);
+	}
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	printf("Done.\n");
+	
+	// Regions are merged in order, so the result only depends on the thread count.
+	list<Triangle*> leftover;
+	for (unsigned int i = 0; i < threads; i++) {
+		leftover.splice(leftover.end(), regionSingles[i]);
+		strips.splice(strips.end(), regionStrips[i]);
+	}
+	
+	if (options.stitch && threads > 1) {
+		printf("Stitching %lu strips and %lu singles across region borders...", (unsigned long)strips.size(), (unsigned long)leftover.size());
+		fflush(stdout);
+		// The leftovers were counted as done by the regions; the stitch pass goes over them again.
+		shared.done = triCount - leftover.size();
+		stripsearch_link_queue(leftover, singles, strips, options, false, start, &shared);
+		stripsearch_join(strips);
+		printf("Done.\n");
+	} else {
+		singles.splice(singles.end(), leftover);
+	}
+	
+	if (options.progress) {
+		StripProgress progress;
+		progress.total = triCount;
+		progress.done = triCount;
+		progress.stripped = shared.stripped;
+		progress.elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		progress.eta = 0;
+		options.progress(progress, options.progressData);
+	}
+}
+
+
+
+// Lowest-degree-first strip search, in the style of SGI's tomesh/STRIPE.
+// Strips are seeded from the triangle with the fewest unstripped neighbours, since those are the ones most likely to
+// end up as singles otherwise, and start off towards whichever neighbour is itself the most isolated.
+// Candidates are checked without rotating them, so unlike stripsearch_link it can pick between rotations safely.
+void stripsearch_greedy(Mesh* mesh, list<Triangle*>& singles, list<list<Triangle*>>& strips, const SMLOptions& options) {
+	uint32_t triCount = mesh->t.size();
+	
+	printf("Building edge adjacency...");
+	fflush(stdout);
+	#ifdef USE_SPARSEHASH
+	dense_hash_map<uint64_t, uint32_t> edges(triCount * 3);
+	edges.set_empty_key(0xFFFFFFFFFFFFFFFFull);
+	#else
+	unordered_map<uint64_t, uint32_t> edges;
+	edges.reserve(triCount * 3);
+	#endif
+	for (uint32_t i = 0; i < triCount; i++) {
+		Triangle* t = mesh->t[i].get();
+		for (int e = 0; e < 3; e++) {
+			// First one wins on non-manifold edges, the rest just don't get linked.
+			edges.insert(make_pair(((uint64_t)t->v[e] << 32) | t->v[(e+1) % 3], i));
+		}
+	}
+	
+	// Triangle across the edge from->to of another triangle, which has it as to->from.
+	auto across = [&](uint32_t from, uint32_t to) -> uint32_t {
+		auto i = edges.find(((uint64_t)to << 32) | from);
+		return i == edges.end() ? 0xFFFFFFFF : i->second;
+	};
+	
+	vector<uint32_t> neighbours(triCount * 3);
+	vector<uint8_t> degree(triCount);
+	vector<bool> used(triCount, false);
+	for (uint32_t i = 0; i < triCount; i++) {
+		Triangle* t = mesh->t[i].get();
+		degree[i] = 0;
+		for (int e = 0; e < 3; e++) {
+			uint32_t n = across(t->v[e], t->v[(e+1) % 3]);
+			// Only link triangles that are each other's across-triangle, so every link is counted in both degrees.
+			if (n == i || edges.find(((uint64_t)t->v[e] << 32) | t->v[(e+1) % 3])->second != i) n = 0xFFFFFFFF;
+			neighbours[i*3 + e] = n;
+			if (n != 0xFFFFFFFF) degree[i]++;
+		}
+	}
+	printf("Done.\n");
+	
+	// Bucket queue on degree. Entries go stale when a triangle's degree drops or it gets used, and are skipped when popped.
+	list<uint32_t> buckets[4];
+	for (uint32_t i = 0; i < triCount; i++) {
+		buckets[degree[i]].push_back(i);
+	}
+	
+	auto use = [&](uint32_t i) {
+		used[i] = true;
+		for (int e = 0; e < 3; e++) {
+			uint32_t n = neighbours[i*3 + e];
+			if (n == 0xFFFFFFFF || used[n] || degree[n] == 0) continue;
+			degree[n]--;
+			buckets[degree[n]].push_back(n);
+		}
+	};
+	
+	// Finds the triangle that continues a strip ending in prev, and which vertex of it has to become 'a'.
+	auto next = [&](Triangle* prev, uint32_t count, int* rotation) -> uint32_t {
+		/* count=0  0 1 2
+		   count=1  0 2 3  a==a, b==c
+		   count=2	3 2 4  a==c, b==b */
+		uint32_t from = (count & 1) ? prev->a : prev->c;
+		uint32_t to = (count & 1) ? prev->c : prev->b;
+		auto i = edges.find(((uint64_t)from << 32) | to);
+		if (i == edges.end() || used[i->second]) return 0xFFFFFFFF;
+		Triangle* cur = mesh->t[i->second].get();
+		for (int r = 0; r < 3; r++) {
+			if (cur->v[r] == from && cur->v[(r+1) % 3] == to) {
+				*rotation = r;
+				return i->second;
+			}
+		}
+		return 0xFFFFFFFF;
+	};
+	
+	uint32_t remaining = triCount;
+	StripTimer timer(triCount, options);
+	for (int b = 0; b < 4; ) {
+		if (buckets[b].empty()) {
+			b++;
+			continue;
+		}
+		uint32_t seed = buckets[b].front();
+		buckets[b].pop_front();
+		if (used[seed] || degree[seed] != b) continue;
+		
+		if (!timer.tick()) {
+			for (uint32_t i = 0; i < triCount; i++) {
+				if (!used[i]) singles.push_back(mesh->t[i].get());
+			}
+			break;
+		}
+		
+		Triangle* start = mesh->t[seed].get();
+		use(seed);
+		remaining--;
+		
+		// Pick the rotation of the seed that leads to the lowest-degree neighbour.
+		int bestRotation = -1;
+		uint32_t bestDegree = 4;
+		for (int r = 0; r < 3; r++) {
+			int unused;
+			uint32_t n = next(start, 1, &unused);
+			if (n != 0xFFFFFFFF && degree[n] < bestDegree) {
+				bestDegree = degree[n];
+				bestRotation = r;
+			}
+			start->rotate();
+		}
+		
+		if (bestRotation < 0) {
+			timer.single();
+			singles.push_back(start);
+		} else {
+			for (int r = 0; r < bestRotation; r++) {
+				start->rotate();
+			}
+			
+			list<Triangle*> strip;
+			strip.push_back(start);
+			Triangle* prev = start;
+			uint32_t count = 1;
+			int rotation;
+			uint32_t n;
+			while ((n = next(prev, count, &rotation)) != 0xFFFFFFFF) {
+				Triangle* cur = mesh->t[n].get();
+				for (int r = 0; r < rotation; r++) {
+					cur->rotate();
+				}
+				use(n);
+				remaining--;
+				strip.push_back(cur);
+				prev = cur;
+				count++;
+			}
+			timer.strip(count);
+			strips.push_back(move(strip));
+		}
+		
+		// Using triangles only ever lowers degrees, so go back and look at the lower buckets.
+		b = 0;
+	}
+	timer.finish();
+}
+
+
+
+// Finds fans: runs of at least (minimum) triangles around one vertex, each sharing an edge out from it with the next,
+// which strips can only take two at a time. The biggest centres go first. Each fan comes out as its centre then the
+// vertices round its rim, and the triangles left over go in rest, in order.
+void fansearch(Mesh* mesh, vector<vector<uint32_t>>& fans, vector<shared_ptr<Triangle>>& rest, unsigned int minimum) {
+	printf("Looking for fans...");
+	fflush(stdout);
+	size_t vertCount = mesh->v.size();
+	size_t triCount = mesh->t.size();
+	if (minimum < 3) minimum = 3;
+	
+	// Each triangle goes round each of its distinct corners once, degenerate ones included, in the count as in the fill.
+	vector<uint32_t> start(vertCount + 1, 0);
+	for (auto& t : mesh->t) {
+		const uint32_t* v = t->v;
+		start[v[0] + 1]++;
+		if (v[1] != v[0]) start[v[1] + 1]++;
+		if (v[2] != v[0] && v[2] != v[1]) start[v[2] + 1]++;
+	}
+	for (size_t v = 0; v < vertCount; v++) start[v + 1] += start[v];
+	vector<uint32_t> around(start[vertCount]);
+	{
+		vector<uint32_t> fill(start.begin(), start.end() - 1);
+		for (uint32_t i = 0; i < triCount; i++) {
+			const uint32_t* v = mesh->t[i]->v;
+			around[fill[v[0]]++] = i;
+			if (v[1] != v[0]) around[fill[v[1]]++] = i;
+			if (v[2] != v[0] && v[2] != v[1]) around[fill[v[2]]++] = i;
+		}
+	}
+	
+	vector<uint32_t> centres;
+	for (uint32_t v = 0; v < vertCount; v++) {
+		if (start[v + 1] - start[v] >= minimum) centres.push_back(v);
+	}
+	sort(centres.begin(), centres.end(), [&](uint32_t a, uint32_t b) {
+		return start[a + 1] - start[a] > start[b + 1] - start[b];
+	});
+	
+	vector<uint8_t> used(triCount, 0);
+	const uint32_t none = 0xFFFFFFFF;
+	vector<uint32_t> next(vertCount, none);	// Rim vertex to the triangle that goes on from it.
+	vector<uint32_t> prev(vertCount, none);	// And to the one that comes round to it.
+	vector<uint32_t> rim;
+	size_t covered = 0;
+	for (uint32_t c : centres) {
+		// Each free triangle here, turned to (c x y), leads round the fan from x to y.
+		for (uint32_t x : rim) next[x] = prev[x] = none;
+		rim.clear();
+		size_t links = 0;
+		for (uint32_t k = start[c]; k < start[c + 1]; k++) {
+			uint32_t i = around[k];
+			if (used[i]) continue;
+			Triangle t = *mesh->t[i];
+			while (t.a != c) t.rotate();
+			if (t.b == c || t.c == c || t.b == t.c) continue;
+			if (next[t.b] == none) {
+				next[t.b] = i;
+				links++;
+			}
+			if (prev[t.c] == none) prev[t.c] = i;
+			rim.push_back(t.b);
+			rim.push_back(t.c);
+		}
+		if (links < minimum) continue;
+		
+		// Walk back to where each run begins, or anywhere round a closed one, then forward from there.
+		for (uint32_t k = start[c]; k < start[c + 1]; k++) {
+			uint32_t i = around[k];
+			if (used[i]) continue;
+			Triangle t = *mesh->t[i];
+			while (t.a != c) t.rotate();
+			if (next[t.b] != i) continue;
+			
+			uint32_t first = t.b;
+			for (size_t steps = 0; steps < links; steps++) {
+				uint32_t back = prev[first];
+				if (back == none || used[back]) break;
+				Triangle p = *mesh->t[back];
+				while (p.a != c) p.rotate();
+				if (next[p.b] != back) break;
+				first = p.b;
+				if (first == t.b) break;
+			}
+			
+			vector<uint32_t> fan = { c, first };
+			vector<uint32_t> taken;
+			uint32_t x = first;
+			while (next[x] != none && !used[next[x]]) {
+				uint32_t j = next[x];
+				Triangle f = *mesh->t[j];
+				while (f.a != c) f.rotate();
+				used[j] = 1;
+				taken.push_back(j);
+				fan.push_back(f.c);
+				x = f.c;
+			}
+			if (taken.size() >= minimum) {
+				fans.push_back(move(fan));
+				covered += taken.size();
+			} else {
+				for (uint32_t j : taken) used[j] = 0;
+			}
+		}
+	}
+	
+	rest.clear();
+	rest.reserve(triCount - covered);
+	for (uint32_t i = 0; i < triCount; i++) {
+		if (!used[i]) rest.push_back(mesh->t[i]);
+	}
+	printf("%u fans, %u of %u triangles.\n", (uint32_t)fans.size(), (uint32_t)covered, (uint32_t)triCount);
 }
\ No newline at end of file
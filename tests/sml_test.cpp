@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <array>
+#include <vector>
+#include <algorithm>
+
+#include "config.h"
+#include "mesh.h"
+#include "sml.h"
+#include "stl.h"
+#include "obj.h"
+#include "meshopt.h"
+
+using namespace std;
+
+typedef array<float, 9> TriCoords;
+
+// Every triangle as its corners' coordinates, starting from the lowest corner, sorted: the same for any two meshes with
+// the same triangles, however they were stored.
+static vector<TriCoords> canonical(Mesh* mesh) {
+	vector<TriCoords> out;
+	auto add = [&](uint32_t a, uint32_t b, uint32_t c) {
+		uint32_t v[3] = { a, b, c };
+		TriCoords best;
+		for (int r = 0; r < 3; r++) {
+			TriCoords t;
+			for (int k = 0; k < 3; k++) {
+				memcpy(&t[k*3], mesh->v[v[(r + k) % 3]]->c, 12);
+			}
+			if (r == 0 || t < best) best = t;
+		}
+		out.push_back(best);
+	};
+	for (auto& t : mesh->t) add(t->a, t->b, t->c);
+	for (auto& q : mesh->q) {
+		add(q->a, q->b, q->c);
+		add(q->a, q->c, q->d);
+	}
+	sort(out.begin(), out.end());
+	return out;
+}
+
+// Counts the top-level segments of each type in a file, and finds the longest of each.
+static vector<size_t> segmentTypes(const char* file, vector<uint32_t>& longest) {
+	vector<size_t> counts(256, 0);
+	longest.assign(256, 0);
+	FILE* fp = fopen(file, "rb");
+	assert(fp);
+	fseek(fp, 8, SEEK_SET);
+	uint8_t type;
+	uint32_t length;
+	while (fread(&type, 1, 1, fp) == 1 && fread(&length, 4, 1, fp) == 1) {
+		counts[type]++;
+		longest[type] = max(longest[type], length);
+		fseek(fp, length, SEEK_CUR);
+	}
+	fclose(fp);
+	return counts;
+}
+
+// A 3000 quad ribbon, which strips into one strip many chunks long, next to a 60 by 60 grid.
+static Mesh* testMesh() {
+	Mesh* mesh = new Mesh();
+	for (int i = 0; i <= 3000; i++) {
+		mesh->add(make_shared<Vertex>(i, 0, 0));
+		mesh->add(make_shared<Vertex>(i, 1, 0));
+	}
+	for (uint32_t i = 0; i < 3000; i++) {
+		mesh->add(make_shared<Triangle>(2*i, 2*i + 2, 2*i + 1));
+		mesh->add(make_shared<Triangle>(2*i + 1, 2*i + 2, 2*i + 3));
+	}
+	uint32_t base = mesh->v.size();
+	for (int y = 0; y <= 60; y++) {
+		for (int x = 0; x <= 60; x++) {
+			mesh->add(make_shared<Vertex>(x, y, 5));
+		}
+	}
+	for (uint32_t y = 0; y < 60; y++) {
+		for (uint32_t x = 0; x < 60; x++) {
+			uint32_t v = base + y*61 + x;
+			mesh->add(make_shared<Triangle>(v, v + 1, v + 61));
+			mesh->add(make_shared<Triangle>(v + 1, v + 62, v + 61));
+		}
+	}
+	return mesh;
+}
+
+static int testChunks() {
+	const struct {
+		const char* name;
+		uint32_t flags;
+		uint8_t split;	// A segment type that has to come out in more than one piece.
+	} modes[] = {
+		{ "plain", SMLFlags::NONE, 3 },
+		{ "strip", SMLFlags::STRIP_LINK, 5 },
+		{ "pack", SMLFlags::STRIP_LINK | SMLFlags::PACK_STRIPS, 6 },
+		{ "varint", SMLFlags::STRIP_LINK | SMLFlags::VARINT_INDICES, 10 },
+		{ "predict", SMLFlags::STRIP_LINK | SMLFlags::PREDICT_VERTICES, 12 },
+		{ "grid", SMLFlags::GRID_VERTICES, 7 },
+		{ "double", SMLFlags::DOUBLE_VERTICES, 2 },
+		{ "index", SMLFlags::STRIP_LINK | SMLFlags::INDEX, 1 },
+	};
+	
+	Mesh* mesh = testMesh();
+	vector<TriCoords> want = canonical(mesh);
+	int failed = 0;
+	for (auto& mode : modes) {
+		Mesh* copy = testMesh();
+		writeSML("chunks.sml", copy, mode.flags);
+		delete copy;
+		
+		vector<uint32_t> longest;
+		vector<size_t> types = segmentTypes("chunks.sml", longest);
+		Mesh* read = readSML("chunks.sml");
+		bool same = canonical(read) == want;
+		delete read;
+		
+		// The ribbon's strip has to be cut into pieces of at most 1024 triangles: 1026 points, 4104 bytes.
+		bool cut = mode.split != 5 || longest[5] <= 12 + 1023*4;
+		if (!same || types[mode.split] < 2 || !cut) {
+			fprintf(stderr, "FAIL %s: %s, %lu segments of type %u, longest %u bytes\n", mode.name,
+				same ? "same triangles" : "triangles differ", (unsigned long)types[mode.split], mode.split, longest[mode.split]);
+			failed = 1;
+		}
+	}
+	delete mesh;
+	remove("chunks.sml");
+	return failed;
+}
+
+// Two triangles back to back, a third on each of two of their edges so those are shared three ways, and two more beside
+// them. Cut down from a triangle soup whose greedy strip search took a degree below zero.
+static Mesh* nonManifoldMesh() {
+	Mesh* mesh = new Mesh();
+	const float coords[7][3] = {
+		{ 2, 6, 9 }, { 0, 5, 0 }, { 0, 8, 2 }, { 4, 8, 1 }, { 1, 5, 3 }, { 4, 1, 1 }, { 6, 4, 9 },
+	};
+	for (auto& c : coords) {
+		mesh->add(make_shared<Vertex>(c[0], c[1], c[2]));
+	}
+	const uint32_t tris[6][3] = {
+		{ 0, 1, 2 }, { 2, 1, 0 }, { 3, 4, 0 }, { 3, 0, 5 }, { 0, 2, 5 }, { 1, 2, 6 },
+	};
+	for (auto& t : tris) {
+		mesh->add(make_shared<Triangle>(t[0], t[1], t[2]));
+	}
+	return mesh;
+}
+
+// Strip searches have to keep every triangle of a mesh whose edges aren't all shared by just two triangles.
+static int testNonManifold() {
+	const struct {
+		const char* name;
+		uint32_t flags;
+	} modes[] = {
+		{ "greedy", SMLFlags::STRIP_GREEDY },
+		{ "greedy join", SMLFlags::STRIP_GREEDY | SMLFlags::VARINT_INDICES | SMLFlags::PACK_STRIPS | SMLFlags::JOIN_STRIPS },
+	};
+	
+	Mesh* mesh = nonManifoldMesh();
+	vector<TriCoords> want = canonical(mesh);
+	int failed = 0;
+	for (auto& mode : modes) {
+		Mesh* copy = nonManifoldMesh();
+		writeSML("nonmanifold.sml", copy, mode.flags);
+		delete copy;
+		
+		Mesh* read = readSML("nonmanifold.sml");
+		if (canonical(read) != want) {
+			fprintf(stderr, "FAIL %s: triangles differ\n", mode.name);
+			failed = 1;
+		}
+		delete read;
+	}
+	delete mesh;
+	remove("nonmanifold.sml");
+	return failed;
+}
+
+// A fan of 14 triangles with a degenerate one at its centre, after a triangle that doesn't touch the centre at all.
+static Mesh* degenerateFanMesh() {
+	Mesh* mesh = new Mesh();
+	mesh->add(make_shared<Vertex>(10, 10, 0));
+	mesh->add(make_shared<Vertex>(11, 10, 0));
+	mesh->add(make_shared<Vertex>(10, 11, 0));
+	mesh->add(make_shared<Triangle>(0, 1, 2));
+	uint32_t centre = mesh->v.size();
+	mesh->add(make_shared<Vertex>(0, 0, 0));
+	for (int k = 0; k <= 14; k++) {
+		mesh->add(make_shared<Vertex>(cos(k * 0.4), sin(k * 0.4), 0));
+	}
+	for (uint32_t k = 0; k < 14; k++) {
+		mesh->add(make_shared<Triangle>(centre, centre + 1 + k, centre + 2 + k));
+	}
+	mesh->add(make_shared<Triangle>(centre, centre, centre + 1));
+	return mesh;
+}
+
+static int testDegenerateFan() {
+	Mesh* mesh = degenerateFanMesh();
+	vector<TriCoords> want = canonical(mesh);
+	writeSML("fan.sml", mesh, SMLFlags::FANS);
+	delete mesh;
+	
+	vector<uint32_t> longest;
+	vector<size_t> types = segmentTypes("fan.sml", longest);
+	Mesh* read = readSML("fan.sml");
+	bool same = canonical(read) == want;
+	delete read;
+	remove("fan.sml");
+	if (!same || !types[20]) {
+		fprintf(stderr, "FAIL degenerate fan: %s, %lu fan segments\n", same ? "same triangles" : "triangles differ",
+			(unsigned long)types[20]);
+		return 1;
+	}
+	return 0;
+}
+
+// Welding has to drop the faces it collapses, and only those: a square whose corners get welded two by two, next to
+// one that doesn't move, with a degenerate triangle and quad of its own.
+static int testWeld() {
+	Mesh* mesh = new Mesh();
+	const float coords[8][3] = {
+		{ 0, 0, 0 }, { 0.001f, 0, 0 }, { 0, 1, 0 }, { 0.001f, 1, 0 }, { 5, 0, 0 }, { 6, 0, 0 }, { 5, 1, 0 }, { 6, 1, 0 },
+	};
+	for (auto& c : coords) {
+		mesh->add(make_shared<Vertex>(c[0], c[1], c[2]));
+	}
+	mesh->add(make_shared<Triangle>(0, 1, 2));
+	mesh->add(make_shared<Triangle>(1, 3, 2));
+	mesh->add(make_shared<Triangle>(4, 5, 6));
+	mesh->add(make_shared<Triangle>(5, 5, 7));
+	const uint32_t quads[3][4] = { { 0, 1, 3, 2 }, { 4, 5, 7, 7 }, { 4, 5, 7, 6 } };
+	for (auto& v : quads) {
+		shared_ptr<Quad> q = make_shared<Quad>();
+		memcpy(q->v, v, 16);
+		mesh->add(q);
+	}
+	
+	weldVertices(mesh, 0.01f);
+	size_t triCount = mesh->t.size(), quadCount = mesh->q.size();
+	delete mesh;
+	if (triCount != 2 || quadCount != 2) {
+		fprintf(stderr, "FAIL weld: %lu triangles and %lu quads left, not 2 and 2\n", (unsigned long)triCount,
+			(unsigned long)quadCount);
+		return 1;
+	}
+	return 0;
+}
+
+// Runs job in a child, which has to exit with an error of its own rather than succeed or crash.
+template <typename Job> static int expectRejected(const char* what, Job job) {
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0) {
+		job();
+		_exit(0);
+	}
+	int status;
+	waitpid(pid, &status, 0);
+	if (WIFEXITED(status) && WEXITSTATUS(status) != 0) return 0;
+	fprintf(stderr, "FAIL %s: %s\n", what, WIFEXITED(status) ? "accepted" : "crashed");
+	return 1;
+}
+
+// 0x80000001 triangles times 50 bytes wraps around 32 bits to the size of a file with just one.
+static int testSTLCount() {
+	FILE* fp = fopen("count.stl", "wb");
+	char header[80] = { 0 };
+	uint32_t count = 0x80000001;
+	char tri[50] = { 0 };
+	fwrite(header, 1, 80, fp);
+	fwrite(&count, 4, 1, fp);
+	fwrite(tri, 1, 50, fp);
+	fclose(fp);
+	
+	int failed = expectRejected("STL triangle count", []() { delete readSTL("count.stl"); });
+	remove("count.stl");
+	return failed;
+}
+
+// Index 4294967298 is vertex 1 again if it's cut down to 32 bits.
+static int testOBJIndex() {
+	FILE* fp = fopen("index.obj", "w");
+	fprintf(fp, "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 4294967298\n");
+	fclose(fp);
+	
+	int failed = expectRejected("OBJ vertex index", []() { delete readOBJ("index.obj"); });
+	remove("index.obj");
+	return failed;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s chunks|nonmanifold|fan|weld|stl|obj\n", argv[0]);
+		return 2;
+	}
+	if (!strcmp(argv[1], "chunks")) return testChunks();
+	if (!strcmp(argv[1], "nonmanifold")) return testNonManifold();
+	if (!strcmp(argv[1], "fan")) return testDegenerateFan();
+	if (!strcmp(argv[1], "weld")) return testWeld();
+	if (!strcmp(argv[1], "stl")) return testSTLCount();
+	if (!strcmp(argv[1], "obj")) return testOBJIndex();
+	fprintf(stderr, "Unknown test '%s'.\n", argv[1]);
+	return 2;
+}
\ No newline at end of file